@@ -11,6 +11,12 @@
 #define CPV03_SIZE 15
 #define CPV03_VERSION 3
 
+// Host to device CODE of version 2 frames: the low bits ask for the move onto
+// the frame to take that many milliseconds, 0 leaves the speed to the device
+#define CPV02_CODE_DURATION 0x7F
+// The frame may be passed through on a blend instead of being stopped at
+#define CPV02_CODE_BLEND 0x80
+
 // The structure is maked with __attribute((packed))
 // because we don't want any structure padding. Otherwise we might
 // send an invalid message to the device.
@@ -20,8 +20,7 @@
 #define RESEND_TIME 5
 #define RX_PROTOCOL_VERSION CPV01_VERSION
 #define RX_PROTOCOL_SIZE CPV01_SIZE
-#define TX_PROTOCOL_VERSION CPV02_VERSION
-#define TX_PROTOCOL_SIZE CPV02_SIZE
+#define TX_PROTOCOL_MAX_SIZE CPV03_SIZE // version 2 and 3 frames are streamed
 
 #define JITTER 0
 #define HOLDING 0
@@ -105,23 +104,68 @@ int main(int argc, char** argv)
   time_t now;
 
   int packets = 0;
-  char buffer[TX_PROTOCOL_SIZE];
-  char corrupted_buffer[TX_PROTOCOL_SIZE];
+  size_t frame_size = CPV02_SIZE;
+  char buffer[TX_PROTOCOL_MAX_SIZE];
+  char corrupted_buffer[TX_PROTOCOL_MAX_SIZE];
 
   // While Still Have Packets in File Queue
   while(!feof(file))
   {
     // Recieved Acknowledgement or First Loop
     if (receiveState == 0){
-      // Read in next frame from file / fgets reads size-1 into buffer
-      if (fread(buffer, 1, TX_PROTOCOL_SIZE, file) > 0){
-        CPFrameVersion02 *frame = (CPFrameVersion02 *) &buffer;
+      // Read in next frame from file, the version says how long it is
+      if (fread(buffer, 1, 2, file) == 2){
+        size_t i;
+        unsigned short frame_crc;
 
-        printf("----> TX F<%d>: %02hhX%02hhX %02hhX%02hhX %02hhX%02hhX %02hhX%02hhX %02hhX%02hhX %02hhX%02hhX\n", packets, buffer[0], buffer[1], buffer[2], buffer[3], buffer[4], buffer[5], buffer[6], buffer[7], buffer[8], buffer[9], buffer[10], buffer[11]);
-        printf("      SFD: %4d, V: %4d, CODE: %4d, THETA1: %6d, THETA2 %6d, D3 %6d, CRC: %4d, EFD: %4d\n", frame->SFD, frame->VERSION, frame->CODE,frame->THETA1, frame->THETA2, frame->D3, frame->CRC, frame->EFD);
+        if (buffer[1] == CPV03_VERSION)
+        {
+          frame_size = CPV03_SIZE;
+        }
+        else if (buffer[1] == CPV02_VERSION)
+        {
+          frame_size = CPV02_SIZE;
+        }
+        else
+        {
+          {
+            char message_buffer[80];
+            sprintf(message_buffer, "Packet <%d> has unknown Communication Protocol Version <%d>.", packets, buffer[1]);
+            send_amqp_message(&conn, TOULOUSE_AMPQ_MESSAGE_ROUTING_KEY, form_message_payload("CP Protocol Error", "error", message_buffer));
+            fprintf(stderr,"      %s\n", message_buffer);
+          }
+          exit(EXIT_FAILURE);
+        }
+        if (fread(buffer + 2, 1, frame_size - 2, file) != frame_size - 2)
+        {
+          {
+            char message_buffer[50];
+            sprintf(message_buffer, "Packet <%d> is truncated.", packets);
+            send_amqp_message(&conn, TOULOUSE_AMPQ_MESSAGE_ROUTING_KEY, form_message_payload("Truncated Packet", "error", message_buffer));
+            fprintf(stderr,"      %s\n", message_buffer);
+          }
+          exit(EXIT_FAILURE);
+        }
+
+        printf("----> TX F<%d>:", packets);
+        for (i = 0; i < frame_size; i++)
+          printf("%s%02hhX", i % 2 ? "" : " ", buffer[i]);
+        printf("\n");
+        if (frame_size == CPV03_SIZE)
+        {
+          CPFrameVersion03 *frame = (CPFrameVersion03 *) &buffer;
+          printf("      SFD: %4d, V: %4d, THETA1: %6d, THETA2 %6d, THETA3 %6d, THETA4 %6d, D5 %6d, CRC: %4d, EFD: %4d\n", frame->SFD, frame->VERSION, frame->THETA1, frame->THETA2, frame->THETA3, frame->THETA4, frame->D5, frame->CRC, frame->EFD);
+          frame_crc = frame->CRC;
+        }
+        else
+        {
+          CPFrameVersion02 *frame = (CPFrameVersion02 *) &buffer;
+          printf("      SFD: %4d, V: %4d, CODE: %4d, THETA1: %6d, THETA2 %6d, D3 %6d, CRC: %4d, EFD: %4d\n", frame->SFD, frame->VERSION, frame->CODE,frame->THETA1, frame->THETA2, frame->D3, frame->CRC, frame->EFD);
+          frame_crc = frame->CRC;
+        }
 
         // Check frame is uncorrupted using CRC
-        if (crcFast((unsigned char *) &buffer, TX_PROTOCOL_SIZE-3) != frame->CRC)
+        if (crcFast((unsigned char *) &buffer, frame_size-3) != frame_crc)
         {
           {
             char message_buffer[50];
@@ -135,12 +179,15 @@ int main(int argc, char** argv)
         // Send Frame to Arduino
         int bytes_written;
         if (JITTER && rand() % 3 == 0) {
-          memcpy(corrupted_buffer, buffer, TX_PROTOCOL_SIZE);
-          corrupted_buffer[rand() % TX_PROTOCOL_SIZE] = 12;
-          printf("      Corrupted TX F<%d>: %02hhX%02hhX %02hhX%02hhX %02hhX%02hhX %02hhX%02hhX %02hhX%02hhX %02hhX%02hhX\n", packets, corrupted_buffer[0], corrupted_buffer[1], corrupted_buffer[2], corrupted_buffer[3], corrupted_buffer[4], corrupted_buffer[5], corrupted_buffer[6], corrupted_buffer[7], corrupted_buffer[8], corrupted_buffer[9], corrupted_buffer[10], corrupted_buffer[11]);
-          bytes_written = write(serial, &corrupted_buffer, TX_PROTOCOL_SIZE);
+          memcpy(corrupted_buffer, buffer, frame_size);
+          corrupted_buffer[rand() % frame_size] = 12;
+          printf("      Corrupted TX F<%d>:", packets);
+          for (i = 0; i < frame_size; i++)
+            printf("%s%02hhX", i % 2 ? "" : " ", corrupted_buffer[i]);
+          printf("\n");
+          bytes_written = write(serial, &corrupted_buffer, frame_size);
         }else{
-          bytes_written = write(serial, &buffer, TX_PROTOCOL_SIZE);
+          bytes_written = write(serial, &buffer, frame_size);
         }
         time(&lastPackage);
         if (bytes_written < 0)
@@ -173,7 +220,7 @@ int main(int argc, char** argv)
           fprintf(stderr,"      %s\n", message_buffer);
         }
         
-        int bytes_written = write(serial, &buffer, TX_PROTOCOL_SIZE);
+        int bytes_written = write(serial, &buffer, frame_size);
         time(&lastPackage);
         if (bytes_written < 0)
         {
@@ -310,9 +357,9 @@ int main(int argc, char** argv)
 
           int bytes_written;
           if (JITTER && rand() % 3 == 0){
-            bytes_written = write(serial, &corrupted_buffer, TX_PROTOCOL_SIZE);
+            bytes_written = write(serial, &corrupted_buffer, frame_size);
           }else{
-            bytes_written = write(serial, &buffer, TX_PROTOCOL_SIZE);            
+            bytes_written = write(serial, &buffer, frame_size);
           }
           time(&lastPackage);
           if (bytes_written < 0)
@@ -332,8 +379,16 @@ int main(int argc, char** argv)
             printf("Recieved Acknowledgement. Moving to Next Packet\n");
           }
 
-          CPFrameVersion02 *processed_frame = (CPFrameVersion02 *) &buffer;
-          send_amqp_message(&conn, TOULOUSE_AMPQ_STATE_ROUTING_KEY, form_update_os_payload(packets, processed_frame));
+          if (frame_size == CPV03_SIZE)
+          {
+            CPFrameVersion03 *processed_frame = (CPFrameVersion03 *) &buffer;
+            send_amqp_message(&conn, TOULOUSE_AMPQ_STATE_ROUTING_KEY, form_update_os_payload_v03(packets, processed_frame));
+          }
+          else
+          {
+            CPFrameVersion02 *processed_frame = (CPFrameVersion02 *) &buffer;
+            send_amqp_message(&conn, TOULOUSE_AMPQ_STATE_ROUTING_KEY, form_update_os_payload(packets, processed_frame));
+          }
         }
       }
     }
@@ -0,0 +1,338 @@
+#include <stdlib.h>
+#include <math.h>
+
+#include "arclength.h"
+
+#define ARCLENGTH_NODES 5
+
+// Gauss-Legendre abscissae and weights on [-1, 1]
+static const double arclength_abscissae[ARCLENGTH_NODES] = {
+  -0.9061798459386640, -0.5384693101056831, 0.0, 0.5384693101056831, 0.9061798459386640
+};
+static const double arclength_weights[ARCLENGTH_NODES] = {
+  0.2369268850561891, 0.4786286704993665, 0.5688888888888889, 0.4786286704993665, 0.2369268850561891
+};
+
+// The derivative on one knot span. Pieces that fit the sampling tables are
+// evaluated from their polynomial in double precision, others with de Boor.
+typedef struct
+{
+  const tsBSpline* derivative;
+  tsRational* scratch;        /* de Boor scratch followed by ARCLENGTH_NODES points */
+  const SamplingSpan* piece;  /* polynomial of the span or NULL */
+  ArcLengthTable* table;      /* records the accepted pieces if not NULL */
+  size_t k;                   /* the knot span */
+  double total;               /* length up to the current piece */
+} ArcLengthSpan;
+
+static double arclength_norm(const double* point, const size_t dim)
+{
+  double squared = 0;
+  size_t d;
+  for (d = 0; d < dim; d++)
+    squared += point[d] * point[d];
+  return sqrt(squared);
+}
+
+// |C'(u)| for a single u inside the span
+static tsError arclength_speed(const ArcLengthSpan* span, const double u, double* speed)
+{
+  const size_t dim = span->derivative->dim;
+  double point[SAMPLING_MAX_DIM];
+  size_t d;
+
+  if (span->piece != NULL)
+  {
+    sampling_span_evaluate(span->piece, u, point);
+    *speed = arclength_norm(point, dim);
+    return TS_SUCCESS;
+  }
+
+  tsRational* values = span->scratch + dim * span->derivative->order;
+  tsError err = ts_bspline_evaluate_point(span->derivative, u, span->scratch, values);
+  if (err < 0)
+    return err;
+
+  double squared = 0;
+  for (d = 0; d < dim; d++)
+    squared += (double) values[d] * values[d];
+  *speed = sqrt(squared);
+  return TS_SUCCESS;
+}
+
+// Integrates |C'| over [a, b] with a single Gauss-Legendre rule. All nodes
+// are inside the interval, so the knot span is never ambiguous.
+static tsError arclength_gauss(const ArcLengthSpan* span, const double a, const double b, double* integral)
+{
+  const size_t dim = span->derivative->dim;
+  const double half = (b - a) / 2;
+  double sum = 0;
+  size_t i, d;
+  tsError err;
+
+  if (span->piece != NULL)
+  {
+    double point[SAMPLING_MAX_DIM];
+    for (i = 0; i < ARCLENGTH_NODES; i++)
+    {
+      sampling_span_evaluate(span->piece, a + half * (1 + arclength_abscissae[i]), point);
+      sum += arclength_weights[i] * arclength_norm(point, dim);
+    }
+  }
+  else
+  {
+    tsRational us[ARCLENGTH_NODES];
+    tsRational* points = span->scratch + dim * span->derivative->order;
+    for (i = 0; i < ARCLENGTH_NODES; i++)
+      us[i] = a + half * (1 + arclength_abscissae[i]);
+    err = ts_bspline_evaluate_many(span->derivative, us, ARCLENGTH_NODES, span->scratch, points);
+    if (err < 0)
+      return err;
+    for (i = 0; i < ARCLENGTH_NODES; i++)
+    {
+      double squared = 0;
+      for (d = 0; d < dim; d++)
+        squared += (double) points[i*dim + d] * points[i*dim + d];
+      sum += arclength_weights[i] * sqrt(squared);
+    }
+  }
+
+  *integral = sum * half;
+  return TS_SUCCESS;
+}
+
+static tsError arclength_table_append(ArcLengthTable* table, const double u, const double length,
+  const size_t k)
+{
+  if (table->n_entries == table->capacity)
+  {
+    const size_t capacity = table->capacity ? table->capacity * 2 : 64;
+    double* us = realloc(table->us, sizeof(double) * capacity);
+    if (us == NULL)
+      return TS_MALLOC;
+    table->us = us;
+    double* lengths = realloc(table->lengths, sizeof(double) * capacity);
+    if (lengths == NULL)
+      return TS_MALLOC;
+    table->lengths = lengths;
+    size_t* spans = realloc(table->spans, sizeof(size_t) * capacity);
+    if (spans == NULL)
+      return TS_MALLOC;
+    table->spans = spans;
+    table->capacity = capacity;
+  }
+
+  table->us[table->n_entries] = u;
+  table->lengths[table->n_entries] = length;
+  table->spans[table->n_entries] = k;
+  table->n_entries++;
+  return TS_SUCCESS;
+}
+
+// Bisects [a, b] until the two halves agree with the \whole within
+// \tolerance, the same per piece criterion the midpoint subdivision used.
+static tsError arclength_adaptive(ArcLengthSpan* span, const double a, const double b,
+  const double whole, const double tolerance, const size_t depth)
+{
+  const double mid = (a + b) / 2;
+  double left, right;
+  tsError err;
+
+  if ((err = arclength_gauss(span, a, mid, &left)) < 0)
+    return err;
+  if ((err = arclength_gauss(span, mid, b, &right)) < 0)
+    return err;
+
+  if (depth >= ARCLENGTH_MAX_DEPTH || fabs(left + right - whole) <= tolerance)
+  {
+    span->total += left + right;
+    if (span->table != NULL)
+      return arclength_table_append(span->table, b, span->total, span->k);
+    return TS_SUCCESS;
+  }
+
+  if ((err = arclength_adaptive(span, a, mid, left, tolerance, depth + 1)) < 0)
+    return err;
+  return arclength_adaptive(span, mid, b, right, tolerance, depth + 1);
+}
+
+// Integrates every knot span of \derivative. \pieces receives the polynomial
+// of every span (indexed by span) or is NULL to keep only the current one.
+static tsError arclength_measure(const tsBSpline* derivative, SamplingSpan* pieces,
+  const double tolerance, ArcLengthTable* table, double* length)
+{
+  const int polynomial = derivative->deg <= SAMPLING_MAX_DEGREE && derivative->dim <= SAMPLING_MAX_DIM;
+  ArcLengthSpan span;
+  SamplingSpan piece;
+  tsError err = TS_SUCCESS;
+
+  span.derivative = derivative;
+  span.table = table;
+  span.total = 0;
+  span.scratch = malloc(sizeof(tsRational) * derivative->dim * (derivative->order + ARCLENGTH_NODES));
+  if (span.scratch == NULL)
+    return TS_MALLOC;
+
+  // The derivative has the same domain and knot spans as the spline
+  for (span.k = derivative->deg; span.k < derivative->n_ctrlp; span.k++)
+  {
+    const double a = derivative->knots[span.k];
+    const double b = derivative->knots[span.k+1];
+    double whole;
+
+    if (b <= a)
+      continue;
+
+    span.piece = NULL;
+    if (polynomial)
+    {
+      SamplingSpan* target = pieces != NULL ? &pieces[span.k] : &piece;
+      if ((err = sampling_span(derivative, span.k, target)) < 0)
+        break;
+      span.piece = target;
+    }
+
+    if ((err = arclength_gauss(&span, a, b, &whole)) < 0)
+      break;
+    if ((err = arclength_adaptive(&span, a, b, whole, tolerance, 0)) < 0)
+      break;
+  }
+
+  *length = span.total;
+  if (table != NULL && err == TS_SUCCESS)
+    table->scratch = span.scratch; /* kept for the inverse lookups */
+  else
+    free(span.scratch);
+  return err;
+}
+
+tsError arclength_length(const tsBSpline* spline, const double tolerance, double* length)
+{
+  tsBSpline derivative;
+  tsError err;
+
+  *length = 0;
+  err = ts_bspline_derive(spline, &derivative);
+  if (err < 0)
+    return err;
+
+  err = arclength_measure(&derivative, NULL, tolerance, NULL, length);
+  ts_bspline_free(&derivative);
+  return err;
+}
+
+tsError arclength_table_new(const tsBSpline* spline, const double tolerance, ArcLengthTable* table)
+{
+  tsError err;
+
+  table->pieces = NULL;
+  table->scratch = NULL;
+  table->tolerance = tolerance;
+  table->length = 0;
+  table->n_entries = table->capacity = 0;
+  table->us = table->lengths = NULL;
+  table->spans = NULL;
+
+  err = ts_bspline_derive(spline, &table->derivative);
+  if (err < 0)
+    return err;
+
+  const tsBSpline* derivative = &table->derivative;
+  if (derivative->deg <= SAMPLING_MAX_DEGREE && derivative->dim <= SAMPLING_MAX_DIM)
+  {
+    table->pieces = malloc(sizeof(SamplingSpan) * derivative->n_ctrlp);
+    if (table->pieces == NULL)
+      err = TS_MALLOC;
+  }
+
+  if (err == TS_SUCCESS)
+    err = arclength_table_append(table, derivative->knots[derivative->deg], 0, derivative->deg);
+  if (err == TS_SUCCESS)
+    err = arclength_measure(derivative, table->pieces, tolerance, table, &table->length);
+
+  if (err < 0)
+  {
+    arclength_table_free(table);
+    table->tolerance = 0;
+  }
+  return err;
+}
+
+void arclength_table_free(ArcLengthTable* table)
+{
+  ts_bspline_free(&table->derivative);
+  free(table->pieces);
+  free(table->scratch);
+  free(table->us);
+  free(table->lengths);
+  free(table->spans);
+  table->pieces = NULL;
+  table->scratch = NULL;
+  table->length = 0;
+  table->n_entries = table->capacity = 0;
+  table->us = table->lengths = NULL;
+  table->spans = NULL;
+}
+
+tsError arclength_table_invert(ArcLengthTable* table, double distance, size_t* cursor, double* u)
+{
+  const size_t last = table->n_entries - 1;
+  ArcLengthSpan span;
+  size_t c = *cursor, step;
+  tsError err;
+
+  if (last == 0)
+  {
+    *u = table->us[0];
+    return TS_SUCCESS;
+  }
+  if (distance < 0)
+    distance = 0;
+  if (distance > table->length)
+    distance = table->length;
+
+  // Find the piece [us[c-1], us[c]] holding the distance, starting over for
+  // distances that are not ascending
+  if (c < 1 || c > last || table->lengths[c-1] > distance)
+    c = 1;
+  while (c < last && table->lengths[c] < distance)
+    c++;
+  *cursor = c;
+
+  const double a = table->us[c-1];
+  const double b = table->us[c];
+  const double offset = distance - table->lengths[c-1];
+  const double piece_length = table->lengths[c] - table->lengths[c-1];
+
+  span.derivative = &table->derivative;
+  span.scratch = table->scratch;
+  span.piece = table->pieces != NULL ? &table->pieces[table->spans[c]] : NULL;
+  span.table = NULL;
+  span.k = table->spans[c];
+  span.total = table->lengths[c-1];
+
+  // Linear estimate inside the piece, refined with Newton steps on the
+  // length of [a, u] whose derivative is the speed |C'(u)|. Steps leaving the
+  // bracket of the root, e.g. close to cusps, bisect it instead.
+  double low = a, high = b;
+  *u = piece_length > 0 ? a + (b - a) * offset / piece_length : a;
+  for (step = 0; step < ARCLENGTH_NEWTON_STEPS && *u > a; step++)
+  {
+    double integral, speed, next;
+    if ((err = arclength_gauss(&span, a, *u, &integral)) < 0)
+      return err;
+    if (fabs(integral - offset) <= table->tolerance)
+      break;
+    if (integral < offset)
+      low = *u;
+    else
+      high = *u;
+    if ((err = arclength_speed(&span, *u, &speed)) < 0)
+      return err;
+    next = speed > 0 ? *u - (integral - offset) / speed : low;
+    if (next <= low || next >= high)
+      next = (low + high) / 2;
+    *u = next;
+  }
+  return TS_SUCCESS;
+}
@@ -0,0 +1,78 @@
+#ifndef ARCLENGTH_H
+#define ARCLENGTH_H
+
+#include <stddef.h>
+
+#include "tinyspline.h"
+#include "sampling.h"
+
+#define ARCLENGTH_MAX_DEPTH 16   /* maximum bisections of a knot span */
+#define ARCLENGTH_NEWTON_STEPS 32 /* maximum refinements of an inverse lookup */
+
+/**
+ * The cumulative arc length of a spline at the ends of the quadrature pieces
+ * ::arclength_length integrates, for mapping distances along the spline back
+ * to knot values.
+ */
+typedef struct
+{
+  tsBSpline derivative;  /* C' of the measured spline */
+  SamplingSpan* pieces;  /* polynomial of C' per knot span, NULL if too large */
+  tsRational* scratch;   /* de Boor scratch for derivatives without pieces */
+  double tolerance;      /* quadrature and inverse lookup tolerance */
+  double length;         /* total arc length */
+  size_t n_entries;      /* number of pieces plus one */
+  size_t capacity;       /* allocated entries */
+  double* us;            /* knot value at the end of every piece, us[0] = u_min */
+  double* lengths;       /* arc length from u_min to us[i] */
+  size_t* spans;         /* knot span of the piece ending at us[i] */
+} ArcLengthTable;
+
+/**
+ * Computes the arc length of \spline, the integral of |C'(u)| over its
+ * domain, in the units of its control points.
+ *
+ * The derivative is taken once with ::ts_bspline_derive. Its norm is
+ * integrated with 5-point Gauss-Legendre quadrature on every knot span, and a
+ * piece is bisected while the quadrature of its two halves differs from the
+ * quadrature of the whole by more than \tolerance.
+ *
+ * @return TS_SUCCESS           on success.
+ * @return TS_MALLOC            if allocating memory failed.
+ * @return TS_UNDERIVABLE       if \spline can not be derived (see
+ *                              ::ts_bspline_derive).
+ */
+tsError arclength_length(const tsBSpline* spline, const double tolerance, double* length);
+
+/**
+ * Measures \spline like ::arclength_length and keeps the cumulative length at
+ * the end of every quadrature piece in \table. Free \table with
+ * ::arclength_table_free.
+ *
+ * On error all values of \table are 0/NULL.
+ *
+ * @return TS_SUCCESS           on success.
+ * @return TS_MALLOC            if allocating memory failed.
+ * @return TS_UNDERIVABLE       if \spline can not be derived.
+ */
+tsError arclength_table_new(const tsBSpline* spline, const double tolerance, ArcLengthTable* table);
+
+/**
+ * Frees all memory of \table.
+ */
+void arclength_table_free(ArcLengthTable* table);
+
+/**
+ * Finds the knot value \u at which the arc length from u_min reaches
+ * \distance (clamped to [0, table->length]). The piece containing \distance
+ * is looked up from \cursor, which should be 0 before the first lookup and is
+ * advanced so that ascending distances are found in one pass over the table.
+ * Inside the piece the linear estimate is refined with safeguarded Newton
+ * steps on the quadrature until the length is within table->tolerance.
+ *
+ * @return TS_SUCCESS           on success.
+ * @return TS_U_UNDEFINED       if the derivative can not be evaluated.
+ */
+tsError arclength_table_invert(ArcLengthTable* table, double distance, size_t* cursor, double* u);
+
+#endif // ARCLENGTH_H
@@ -0,0 +1,96 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+struct ArenaBlock
+{
+  ArenaBlock* next;     /* the previously filled block */
+  size_t size;          /* usable bytes in data */
+  size_t used;          /* bytes handed out from data */
+  unsigned char data[];
+};
+
+static ArenaBlock* arena_block(size_t size, ArenaBlock* next)
+{
+  ArenaBlock* block = malloc(sizeof(ArenaBlock) + size);
+  if (block == NULL)
+    return NULL;
+  block->next = next;
+  block->size = size;
+  block->used = 0;
+  return block;
+}
+
+void arena_init(Arena* arena, size_t capacity)
+{
+  arena->head = NULL;
+  arena->capacity = capacity < ARENA_MIN_BLOCK ? ARENA_MIN_BLOCK : capacity;
+}
+
+void* arena_alloc(Arena* arena, size_t size)
+{
+  ArenaBlock* block = arena->head;
+
+  if (block != NULL)
+  {
+    // Align the address rather than the offset, data itself is only
+    // aligned like the block header
+    uintptr_t address = (uintptr_t) (block->data + block->used);
+    size_t padding = (ARENA_ALIGNMENT - address % ARENA_ALIGNMENT) % ARENA_ALIGNMENT;
+    if (block->used + padding + size <= block->size)
+    {
+      block->used += padding + size;
+      return block->data + block->used - size;
+    }
+  }
+
+  // Chain a block large enough for this allocation and its alignment
+  size_t capacity = arena->capacity;
+  while (capacity < size + ARENA_ALIGNMENT)
+    capacity *= 2;
+  block = arena_block(capacity, arena->head);
+  if (block == NULL)
+    return NULL;
+  arena->head = block;
+  arena->capacity = capacity * 2;
+  return arena_alloc(arena, size);
+}
+
+void arena_reset(Arena* arena)
+{
+  ArenaBlock* block = arena->head;
+
+  if (block == NULL)
+    return;
+
+  if (block->next == NULL)
+  {
+    block->used = 0;
+    return;
+  }
+
+  // Merge the chain into one block of the total size
+  size_t total = 0;
+  while (block != NULL)
+  {
+    ArenaBlock* next = block->next;
+    total += block->size;
+    free(block);
+    block = next;
+  }
+  arena->head = NULL;
+  arena->capacity = total;
+}
+
+void arena_free(Arena* arena)
+{
+  ArenaBlock* block = arena->head;
+  while (block != NULL)
+  {
+    ArenaBlock* next = block->next;
+    free(block);
+    block = next;
+  }
+  arena->head = NULL;
+}
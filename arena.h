@@ -0,0 +1,48 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_ALIGNMENT 16  /* alignment of every allocation */
+#define ARENA_MIN_BLOCK 65536
+
+typedef struct ArenaBlock ArenaBlock;
+
+/**
+ * A bump allocator. Allocations are carved from large blocks and released
+ * all at once by ::arena_reset, which keeps the memory for the next round.
+ */
+typedef struct
+{
+  ArenaBlock* head;   /* block allocations are taken from, NULL if none */
+  size_t capacity;    /* size of the next block */
+} Arena;
+
+/**
+ * Prepares an empty \arena whose first block holds at least \capacity bytes.
+ * No memory is allocated before the first ::arena_alloc.
+ */
+void arena_init(Arena* arena, size_t capacity);
+
+/**
+ * Returns \size bytes aligned to ARENA_ALIGNMENT, valid until the next
+ * ::arena_reset or ::arena_free. A new block is chained when the current
+ * one is exhausted, so earlier allocations never move.
+ *
+ * @return NULL if allocating a block failed (errno is set).
+ */
+void* arena_alloc(Arena* arena, size_t size);
+
+/**
+ * Releases all allocations of \arena. If the last round needed more than one
+ * block, the blocks are merged into a single block of their total size, so
+ * a steady workload settles on one block and no further allocator calls.
+ */
+void arena_reset(Arena* arena);
+
+/**
+ * Frees all blocks of \arena.
+ */
+void arena_free(Arena* arena);
+
+#endif // ARENA_H
@@ -0,0 +1,394 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "calibration.h"
+#include "kinematics.h"
+#include "crc.h"
+#include "CPFrames.h"
+
+#define CALIBRATION_LINE 256
+#define CALIBRATION_SINGULAR 1e-12 /* pivot, relative to the largest, below which the points do not fix the surface */
+#define CALIBRATION_ANGLES 4096    /* steps either way the cosines and sines of replanning are tabled for */
+
+// Terms of a surface of degree
+static size_t calibration_terms(int degree)
+{
+  return (degree + 1) * (degree + 2) / 2;
+}
+
+// The terms x^i y^j at x, y in the order of the coefficients
+static void calibration_basis(int degree, double x, double y, double* basis)
+{
+  double xs[CALIBRATION_MAX_DEGREE + 1], ys[CALIBRATION_MAX_DEGREE + 1];
+  size_t k = 0;
+  int d, j;
+
+  xs[0] = ys[0] = 1;
+  for (d = 1; d <= degree; d++)
+  {
+    xs[d] = xs[d - 1] * x;
+    ys[d] = ys[d - 1] * y;
+  }
+  for (d = 0; d <= degree; d++)
+  {
+    for (j = 0; j <= d; j++)
+      basis[k++] = xs[d - j] * ys[j];
+  }
+}
+
+// Solves the n equations a x = b in place by Gaussian elimination with
+// partial pivoting, leaving x in b
+static int calibration_solve(double* a, double* b, size_t n)
+{
+  size_t i, j, k;
+  double largest = 0;
+
+  for (i = 0; i < n * n; i++)
+    largest = fmax(largest, fabs(a[i]));
+  for (k = 0; k < n; k++)
+  {
+    size_t pivot = k;
+    for (i = k + 1; i < n; i++)
+    {
+      if (fabs(a[i * n + k]) > fabs(a[pivot * n + k]))
+        pivot = i;
+    }
+    if (fabs(a[pivot * n + k]) <= CALIBRATION_SINGULAR * largest)
+      return -1;
+    if (pivot != k)
+    {
+      for (j = 0; j < n; j++)
+      {
+        double t = a[k * n + j];
+        a[k * n + j] = a[pivot * n + j];
+        a[pivot * n + j] = t;
+      }
+      double t = b[k];
+      b[k] = b[pivot];
+      b[pivot] = t;
+    }
+    for (i = k + 1; i < n; i++)
+    {
+      const double factor = a[i * n + k] / a[k * n + k];
+      for (j = k; j < n; j++)
+        a[i * n + j] -= factor * a[k * n + j];
+      b[i] -= factor * b[k];
+    }
+  }
+  for (k = n; k-- > 0;)
+  {
+    for (j = k + 1; j < n; j++)
+      b[k] -= a[k * n + j] * b[j];
+    b[k] /= a[k * n + k];
+  }
+  return 0;
+}
+
+// Fits the surface of calibration to the n points at x, y with heights z by
+// least squares, through the normal equations in coordinates scaled to
+// [-1, 1] so the powers stay comparable
+static int calibration_fit(Calibration* calibration, const double* x, const double* y, const double* z, size_t n)
+{
+  const size_t terms = calibration_terms(calibration->degree);
+  double normal[CALIBRATION_TERMS * CALIBRATION_TERMS] = {0}, right[CALIBRATION_TERMS] = {0};
+  double basis[CALIBRATION_TERMS];
+  size_t i, j, k;
+
+  if (n < terms)
+    return -1;
+  calibration->scale = 0;
+  for (i = 0; i < n; i++)
+    calibration->scale = fmax(calibration->scale, fmax(fabs(x[i]), fabs(y[i])));
+  if (calibration->scale == 0)
+    calibration->scale = 1;
+
+  for (i = 0; i < n; i++)
+  {
+    calibration_basis(calibration->degree, x[i] / calibration->scale, y[i] / calibration->scale, basis);
+    for (j = 0; j < terms; j++)
+    {
+      for (k = 0; k < terms; k++)
+        normal[j * terms + k] += basis[j] * basis[k];
+      right[j] += basis[j] * z[i];
+    }
+  }
+  if (calibration_solve(normal, right, terms) == -1)
+    return -1;
+  memset(calibration->coefficients, 0, sizeof(calibration->coefficients));
+  memcpy(calibration->coefficients, right, sizeof(double) * terms);
+
+  double sum_squared = 0;
+  calibration->max_error = 0;
+  for (i = 0; i < n; i++)
+  {
+    const double error = calibration_height(calibration, x[i], y[i]) - z[i];
+    sum_squared += error * error;
+    calibration->max_error = fmax(calibration->max_error, fabs(error));
+  }
+  calibration->rms = sqrt(sum_squared / n);
+  calibration->n_points = n;
+  return 0;
+}
+
+int calibration_load(Calibration* calibration, const char* path, size_t* line)
+{
+  char text[CALIBRATION_LINE];
+  double *x = NULL, *y = NULL, *z = NULL;
+  size_t n = 0, capacity = 0;
+  int status = 0;
+
+  *line = 0;
+  FILE* file = fopen(path, "r");
+  if (file == NULL)
+    return -1;
+
+  calibration->degree = 1;
+  while (fgets(text, sizeof(text), file) != NULL)
+  {
+    char keyword[16], rest[2];
+    double a, b, c;
+    int fields;
+
+    (*line)++;
+    char* comment = strchr(text, '#');
+    if (comment != NULL)
+      *comment = '\0';
+    fields = sscanf(text, "%15s %lf %lf %lf %1s", keyword, &a, &b, &c, rest);
+    if (fields <= 0)
+      continue;
+
+    if (strcmp(keyword, "degree") == 0 && fields == 2 && a == floor(a) && a >= 0 && a <= CALIBRATION_MAX_DEGREE)
+    {
+      calibration->degree = a;
+    }
+    else if (strcmp(keyword, "retract") == 0 && fields == 2)
+    {
+      calibration->retract = a;
+    }
+    else if (strcmp(keyword, "lifted") == 0 && fields == 2)
+    {
+      calibration->lifted = a;
+    }
+    else if (strcmp(keyword, "point") == 0 && fields == 4)
+    {
+      if (n == capacity)
+      {
+        capacity = capacity ? capacity * 2 : 16;
+        double *grown_x = realloc(x, sizeof(double) * capacity);
+        if (grown_x != NULL)
+          x = grown_x;
+        double *grown_y = realloc(y, sizeof(double) * capacity);
+        if (grown_y != NULL)
+          y = grown_y;
+        double *grown_z = realloc(z, sizeof(double) * capacity);
+        if (grown_z != NULL)
+          z = grown_z;
+        if (grown_x == NULL || grown_y == NULL || grown_z == NULL)
+        {
+          status = -1;
+          break;
+        }
+      }
+      x[n] = a;
+      y[n] = b;
+      z[n++] = c;
+    }
+    else
+    {
+      errno = EINVAL;
+      status = -1;
+      break;
+    }
+  }
+  if (status == 0 && ferror(file))
+    status = -1;
+
+  if (status == 0)
+  {
+    *line = 0;
+    if (calibration_fit(calibration, x, y, z, n) == -1)
+    {
+      errno = EINVAL;
+      status = -1;
+    }
+  }
+
+  int err = errno;
+  free(x);
+  free(y);
+  free(z);
+  fclose(file);
+  errno = err;
+  return status;
+}
+
+double calibration_height(const Calibration* calibration, double x, double y)
+{
+  double basis[CALIBRATION_TERMS], height = 0;
+  size_t k;
+
+  calibration_basis(calibration->degree, x / calibration->scale, y / calibration->scale, basis);
+  for (k = 0; k < calibration_terms(calibration->degree); k++)
+    height += calibration->coefficients[k] * basis[k];
+  return height;
+}
+
+// Size of the frame at frame, 0 if it does not check out
+static size_t calibration_frame_size(const unsigned char* frame, size_t remaining)
+{
+  size_t size;
+  unsigned short crc;
+
+  if (remaining < 2 || frame[0] != StartFrameDelimiter)
+    return 0;
+  if (frame[1] == CPV02_VERSION)
+    size = CPV02_SIZE;
+  else if (frame[1] == CPV03_VERSION)
+    size = CPV03_SIZE;
+  else
+    return 0;
+  if (remaining < size || frame[size - 1] != EndOfFrame)
+    return 0;
+
+  memcpy(&crc, frame + size - 3, sizeof(crc));
+  return crcFast(frame, size - 3) == crc ? size : 0;
+}
+
+// Cosine and sine of every whole step from -CALIBRATION_ANGLES to
+// CALIBRATION_ANGLES, the joints of the frames are whole steps
+static double* calibration_angles(void)
+{
+  double* table = malloc(sizeof(double) * 2 * (2 * CALIBRATION_ANGLES + 1));
+  int step;
+
+  if (table == NULL)
+    return NULL;
+  for (step = -CALIBRATION_ANGLES; step <= CALIBRATION_ANGLES; step++)
+  {
+    table[2 * (step + CALIBRATION_ANGLES)] = cos(step / StepsPerRadian);
+    table[2 * (step + CALIBRATION_ANGLES) + 1] = sin(step / StepsPerRadian);
+  }
+  return table;
+}
+
+// Sets the height of frame at the pen position of its joints, with the
+// cosines and sines from angles, returns 1 if it changed, 0 if not and -1
+// for a frame off the paper
+static int calibration_replan_frame(const Calibration* calibration, const double* angles, unsigned char* frame, size_t size)
+{
+  int16_t theta1, theta2, height;
+  unsigned short crc;
+  double x, y;
+
+  // Version 3 frames have no CODE, the joints start a byte earlier
+  const size_t joints = size == CPV03_SIZE ? offsetof(CPFrameVersion03, THETA1) : offsetof(CPFrameVersion02, THETA1);
+  const size_t at = size == CPV03_SIZE ? offsetof(CPFrameVersion03, D5) : offsetof(CPFrameVersion02, D3);
+  memcpy(&theta1, frame + joints, sizeof(theta1));
+  memcpy(&theta2, frame + joints + sizeof(theta1), sizeof(theta2));
+  memcpy(&height, frame + at, sizeof(height));
+  if (height <= calibration->lifted)
+    return -1;
+
+  // The same as kinematics_forward, without the trigonometry
+  const int theta12 = theta1 + theta2;
+  if (abs(theta1) <= CALIBRATION_ANGLES && abs(theta12) <= CALIBRATION_ANGLES)
+  {
+    const double* angle1 = angles + 2 * (theta1 + CALIBRATION_ANGLES);
+    const double* angle12 = angles + 2 * (theta12 + CALIBRATION_ANGLES);
+    x = ShoulderPanLinkLength * angle1[0] + ElbowPanLinkLength * angle12[0];
+    y = ShoulderPanLinkLength * angle1[1] + ElbowPanLinkLength * angle12[1];
+  }
+  else
+  {
+    kinematics_forward(theta1, theta2, ShoulderPanLinkLength, ElbowPanLinkLength, &x, &y);
+  }
+  const int16_t replanned = floor(calibration_height(calibration, x, y));
+  if (replanned == height)
+    return 0;
+  memcpy(frame + at, &replanned, sizeof(replanned));
+  crc = crcFast(frame, size - 3);
+  memcpy(frame + size - 3, &crc, sizeof(crc));
+  return 1;
+}
+
+int calibration_replan(const Calibration* calibration, const char* path, CalibrationReplan* report)
+{
+  struct stat st;
+  size_t offset, size;
+  int status = 0;
+
+  memset(report, 0, sizeof(CalibrationReplan));
+  int fd = open(path, O_RDWR);
+  if (fd == -1)
+    return -1;
+  if (fstat(fd, &st) == -1)
+  {
+    close(fd);
+    return -1;
+  }
+  if (st.st_size == 0)
+    return close(fd);
+
+  unsigned char* map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED)
+  {
+    int err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+  }
+
+  // Every frame is checked before the first is changed
+  for (offset = 0; offset < (size_t) st.st_size; offset += size)
+  {
+    size = calibration_frame_size(map + offset, st.st_size - offset);
+    if (size == 0)
+    {
+      errno = EILSEQ;
+      status = -1;
+      break;
+    }
+    report->frames++;
+  }
+
+  double* angles = status == 0 ? calibration_angles() : NULL;
+  if (status == 0 && angles == NULL)
+    status = -1;
+  for (offset = 0; status == 0 && offset < (size_t) st.st_size; offset += size)
+  {
+    size = map[offset + 1] == CPV03_VERSION ? CPV03_SIZE : CPV02_SIZE;
+    switch (calibration_replan_frame(calibration, angles, map + offset, size))
+    {
+      case 1:
+        report->changed++;
+        break;
+      case -1:
+        report->kept++;
+        break;
+    }
+  }
+
+  int err = errno;
+  free(angles);
+  if (munmap(map, st.st_size) == -1 && status == 0)
+  {
+    err = errno;
+    status = -1;
+  }
+  if (close(fd) == -1 && status == 0)
+  {
+    err = errno;
+    status = -1;
+  }
+  errno = err;
+  return status;
+}
@@ -0,0 +1,75 @@
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include <stddef.h>
+
+#define CALIBRATION_MAX_DEGREE 3
+#define CALIBRATION_TERMS ((CALIBRATION_MAX_DEGREE + 1) * (CALIBRATION_MAX_DEGREE + 2) / 2)
+
+/**
+ * The height of the linear actuator over the page, a polynomial in the pen
+ * position fitted to heights measured by hand. A calibration file is a text
+ * file with one entry per line:
+ *
+ *      degree <n>          degree of the surface, 0 to CALIBRATION_MAX_DEGREE
+ *      retract <height>    height of the lifted pen
+ *      lifted <height>     heights at or below it are off the paper
+ *      point <x> <y> <height>
+ *
+ * Pen positions are in inches, heights in actuator units, and everything
+ * after a '#' is a comment. The surface needs at least as many points as it
+ * has terms, three for a plane.
+ */
+typedef struct
+{
+  double retract;        /* height of the lifted pen */
+  double lifted;         /* heights at or below it are not on the paper */
+  int degree;            /* of the surface */
+  double scale;          /* inches the pen position is divided by before the polynomial */
+  double coefficients[CALIBRATION_TERMS]; /* of x^i y^j, by total degree, then by falling i */
+  size_t n_points;       /* measured heights the surface was fitted to */
+  double rms, max_error; /* residuals of the fit */
+} Calibration;
+
+/**
+ * Heights changed by ::calibration_replan, per file.
+ */
+typedef struct
+{
+  size_t frames;
+  size_t changed;  /* frames whose height changed */
+  size_t kept;     /* frames off the paper, left as they were */
+} CalibrationReplan;
+
+/**
+ * Reads the calibration file \path into \calibration and fits the surface
+ * to its points by least squares. Entries the file leaves out keep the value
+ * \calibration had, the degree defaults to 1. \line is set to the line an
+ * error was found on, 0 if it was not a line.
+ *
+ * @return 0    on success.
+ * @return -1   if the file could not be read, a line could not be parsed
+ *              or the points do not determine the surface (errno is set).
+ */
+int calibration_load(Calibration* calibration, const char* path, size_t* line);
+
+/**
+ * Returns the height of the actuator with the pen at \x, \y in inches.
+ */
+double calibration_height(const Calibration* calibration, double x, double y);
+
+/**
+ * Rewrites the heights of the packets file \path in place for the pen
+ * positions that forward kinematics gives for the joints of every frame.
+ * Only the height and the CRC of a frame change, frames with a height at
+ * or below \calibration->lifted are kept. Version 2 and 3 frames may be
+ * mixed. A file with a frame that does not check out is not touched. The
+ * durations version 2 frames ask for stay as they were planned.
+ *
+ * @return 0    on success.
+ * @return -1   if the file could not be mapped or holds a corrupted frame
+ *              (errno is set, EILSEQ for a corrupted frame).
+ */
+int calibration_replan(const Calibration* calibration, const char* path, CalibrationReplan* report);
+
+#endif // CALIBRATION_H
@@ -0,0 +1,402 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h> // memchr, memcpy
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "curves.h"
+
+#define CURVES_INITIAL_CAPACITY 128
+#define CURVES_MAX_FAST_DIGITS 19 /* decimal digits that always fit a uint64_t */
+#define CURVES_MAX_EXACT_MANTISSA (1ULL << 53)
+#define CURVES_FALLBACK_EXTENT 128
+
+// Powers of ten that are exactly representable as doubles
+static const double curves_pow10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static int curves_is_space(char c)
+{
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f';
+}
+
+static int curves_is_digit(char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+// Slow path for anything the fast decoder cannot round exactly (more than 19
+// significant digits, huge exponents, inf/nan). strtod needs a terminated
+// string, so the token is copied out of the read-only mapping first. The
+// planner never calls setlocale, so strtod always uses the "C" locale here.
+static double curves_parse_float_slow(const char* start, const char* end)
+{
+  char buffer[CURVES_FALLBACK_EXTENT];
+  size_t len = end - start;
+  if (len >= sizeof(buffer))
+    len = sizeof(buffer) - 1;
+  memcpy(buffer, start, len);
+  buffer[len] = '\0';
+  return strtod(buffer, NULL);
+}
+
+// Decodes the decimal number at the start of [start, end) the same way atof
+// does: leading white space is skipped and trailing garbage is ignored.
+// Mantissas below 2^53 combined with exponents up to 22 are exact in double
+// precision (Clinger's fast path), so the result is identical to atof.
+static double curves_parse_float(const char* start, const char* end)
+{
+  const char* p = start;
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  int negative = 0;
+  int seen_digit = 0;
+
+  while (p < end && curves_is_space(*p))
+    p++;
+
+  if (p < end && (*p == '-' || *p == '+'))
+  {
+    negative = (*p == '-');
+    p++;
+  }
+
+  // Integer part, leading zeros do not count as significant digits
+  for (; p < end && curves_is_digit(*p); p++)
+  {
+    seen_digit = 1;
+    if (mantissa == 0 && *p == '0')
+      continue;
+    if (digits == CURVES_MAX_FAST_DIGITS)
+      return curves_parse_float_slow(start, end);
+    mantissa = mantissa * 10 + (*p - '0');
+    digits++;
+  }
+
+  // Fractional part
+  if (p < end && *p == '.')
+  {
+    for (p++; p < end && curves_is_digit(*p); p++)
+    {
+      seen_digit = 1;
+      exponent--;
+      if (mantissa == 0 && *p == '0')
+        continue;
+      if (digits == CURVES_MAX_FAST_DIGITS)
+        return curves_parse_float_slow(start, end);
+      mantissa = mantissa * 10 + (*p - '0');
+      digits++;
+    }
+  }
+
+  if (!seen_digit)
+    return curves_parse_float_slow(start, end);
+
+  // Exponent
+  if (p < end && (*p == 'e' || *p == 'E'))
+  {
+    const char* e = p + 1;
+    int e_negative = 0;
+    int e_value = 0;
+    if (e < end && (*e == '-' || *e == '+'))
+    {
+      e_negative = (*e == '-');
+      e++;
+    }
+    if (e < end && curves_is_digit(*e))
+    {
+      for (; e < end && curves_is_digit(*e); e++)
+      {
+        if (e_value > 1000)
+          return curves_parse_float_slow(start, end);
+        e_value = e_value * 10 + (*e - '0');
+      }
+      exponent += e_negative ? -e_value : e_value;
+    }
+  }
+
+  if (mantissa > CURVES_MAX_EXACT_MANTISSA || exponent > 22 || exponent < -22)
+    return curves_parse_float_slow(start, end);
+
+  double value = (double) mantissa;
+  if (exponent < 0)
+    value /= curves_pow10[-exponent];
+  else
+    value *= curves_pow10[exponent];
+
+  return negative ? -value : value;
+}
+
+static int curves_is_blank(const char* start, const char* end)
+{
+  for (; start < end; start++)
+  {
+    if (!curves_is_space(*start))
+      return 0;
+  }
+  return 1;
+}
+
+static int curves_reserve(CurvesReader* reader, size_t count)
+{
+  if (count <= reader->capacity)
+    return 0;
+
+  size_t capacity = reader->capacity ? reader->capacity : CURVES_INITIAL_CAPACITY;
+  while (capacity < count)
+    capacity *= 2;
+
+  tsRational* values = realloc(reader->values, capacity * sizeof(tsRational));
+  if (values == NULL)
+    return -1;
+
+  reader->values = values;
+  reader->capacity = capacity;
+  return 0;
+}
+
+static int curves_open_binary(CurvesReader* reader)
+{
+  const CurvesBinaryHeader* header = (const CurvesBinaryHeader*) reader->map;
+
+  if (header->version != CURVES_BINARY_VERSION ||
+      header->rational_size != sizeof(tsRational))
+    return -1;
+
+  // Index and values must both lie within the mapping
+  size_t available = reader->size - sizeof(CurvesBinaryHeader);
+  if (header->n_strokes > available / sizeof(CurvesBinaryIndex))
+    return -1;
+  available -= header->n_strokes * sizeof(CurvesBinaryIndex);
+  if (header->n_values > available / sizeof(tsRational))
+    return -1;
+
+  reader->index = (const CurvesBinaryIndex*) (header + 1);
+  reader->n_strokes = header->n_strokes;
+  return 0;
+}
+
+int curves_open(const char* path, CurvesReader* reader)
+{
+  memset(reader, 0, sizeof(CurvesReader));
+
+  int fd = open(path, O_RDONLY);
+  if (fd == -1)
+    return -1;
+
+  struct stat st;
+  if (fstat(fd, &st) == -1)
+  {
+    close(fd);
+    return -1;
+  }
+
+  // An empty file cannot be mapped but is a valid file without any strokes
+  if (st.st_size > 0)
+  {
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+    {
+      close(fd);
+      return -1;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    reader->map = map;
+    reader->size = st.st_size;
+  }
+
+  // The mapping stays valid after the descriptor is closed
+  close(fd);
+
+  // SVG documents start with '<', possibly after a byte order mark
+  const char* first = reader->map;
+  const char* end_of_file = reader->map + reader->size;
+  if (reader->size >= 3 && memcmp(first, "\xEF\xBB\xBF", 3) == 0)
+    first += 3;
+  while (first < end_of_file && curves_is_space(*first))
+    first++;
+  if (first < end_of_file && *first == '<')
+  {
+    reader->is_svg = 1;
+    svg_begin(&reader->svg, reader->map, reader->size);
+  }
+  else if (reader->size >= sizeof(CurvesBinaryHeader) &&
+      memcmp(reader->map, CURVES_BINARY_MAGIC, 4) == 0)
+  {
+    if (curves_open_binary(reader) == -1)
+    {
+      curves_close(reader);
+      errno = EINVAL;
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+int curves_stroke_at(const CurvesReader* reader, size_t i, CurvesStroke* stroke)
+{
+  if (reader->index == NULL || i >= reader->n_strokes)
+    return 0;
+
+  const CurvesBinaryHeader* header = (const CurvesBinaryHeader*) reader->map;
+  const CurvesBinaryIndex* entry = &reader->index[i];
+  tsRational* values = (tsRational*) (reader->index + reader->n_strokes);
+
+  if (entry->offset > header->n_values ||
+      (uint64_t) entry->n_values + entry->n_knots > header->n_values - entry->offset ||
+      entry->n_values % 2 != 0 || entry->deg == 0 || entry->deg >= entry->n_values / 2 ||
+      entry->n_knots != entry->n_values / 2 + entry->deg + 1)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  // The planner samples u from 0 to 1, so the knots must ascend and be
+  // clamped to it
+  const tsRational* knots = values + entry->offset + entry->n_values;
+  uint32_t k;
+  for (k = 0; k < entry->n_knots; k++)
+  {
+    if ((k <= entry->deg && knots[k] != 0) || (k >= entry->n_knots - entry->deg - 1 && knots[k] != 1) ||
+        (k > 0 && !(knots[k] >= knots[k - 1])))
+    {
+      errno = EINVAL;
+      return -1;
+    }
+  }
+
+  stroke->tool = entry->tool;
+  stroke->n_values = entry->n_values;
+  stroke->ctrlp = values + entry->offset;
+  stroke->deg = entry->deg;
+  stroke->n_knots = entry->n_knots;
+  stroke->knots = stroke->ctrlp + entry->n_values;
+  return 1;
+}
+
+int curves_next(CurvesReader* reader, CurvesStroke* stroke)
+{
+  const char* end_of_file = reader->map + reader->size;
+
+  if (reader->index != NULL)
+  {
+    int status = curves_stroke_at(reader, reader->line, stroke);
+    if (status == 1)
+      reader->line++;
+    return status;
+  }
+
+  if (reader->is_svg)
+  {
+    int status = svg_next(&reader->svg, &reader->values, &reader->capacity, &stroke->n_values);
+    if (status == 1)
+    {
+      reader->line++;
+      stroke->tool = 1;
+      stroke->ctrlp = reader->values;
+      stroke->deg = curves_stroke_degree(stroke->n_values);
+      stroke->n_knots = 0;
+      stroke->knots = NULL;
+    }
+    return status;
+  }
+
+  while (reader->pos < reader->size)
+  {
+    const char* line = reader->map + reader->pos;
+    const char* end = memchr(line, '\n', end_of_file - line);
+    if (end == NULL)
+      end = end_of_file;
+
+    reader->pos = (end - reader->map) + 1;
+    reader->line++;
+
+    if (curves_is_blank(line, end))
+      continue;
+
+    // Parsing Tool Number
+    const char* token = line;
+    const char* semicolon = memchr(line, ';', end - line);
+    stroke->tool = 0;
+    if (semicolon != NULL)
+    {
+      stroke->tool = (int) curves_parse_float(line, semicolon);
+      token = semicolon + 1;
+    }
+
+    // Parsing Control Points
+    size_t count = 0;
+    while (token < end)
+    {
+      const char* comma = memchr(token, ',', end - token);
+      if (comma == NULL)
+        comma = end;
+
+      if (!curves_is_blank(token, comma))
+      {
+        if (curves_reserve(reader, count + 1) == -1)
+          return -1;
+        reader->values[count++] = curves_parse_float(token, comma);
+      }
+      token = comma + 1;
+    }
+
+    stroke->n_values = count;
+    stroke->ctrlp = reader->values;
+    stroke->deg = curves_stroke_degree(count);
+    stroke->n_knots = 0;
+    stroke->knots = NULL;
+    return 1;
+  }
+
+  return 0;
+}
+
+size_t curves_stroke_degree(size_t n_values)
+{
+  return ((n_values-1)/3 == 1) ? 1 : 3;
+}
+
+int curves_stroke_spline(const CurvesStroke* stroke, tsBSpline* spline)
+{
+  if (stroke->knots != NULL)
+  {
+    // The mapping already holds ctrlp followed by knots, just point at it
+    spline->deg = stroke->deg;
+    spline->order = stroke->deg + 1;
+    spline->dim = 2;
+    spline->n_ctrlp = stroke->n_values / 2;
+    spline->n_knots = stroke->n_knots;
+    spline->ctrlp = stroke->ctrlp;
+    spline->knots = stroke->knots;
+    return 1;
+  }
+
+  tsError err = ts_bspline_new(
+    stroke->deg,      /* degree of spline */
+    2,      /* dimension of each point */
+    stroke->n_values/2,      /* number of control points */
+    TS_CLAMPED, /* used to hit first and last control point */
+    spline /* the spline to setup */
+  );
+  if (err < 0)
+    return err;
+
+  memcpy(spline->ctrlp, stroke->ctrlp, sizeof(tsRational) * stroke->n_values);
+  return 0;
+}
+
+void curves_close(CurvesReader* reader)
+{
+  if (reader->map != NULL)
+    munmap((void*) reader->map, reader->size);
+  free(reader->values);
+  memset(reader, 0, sizeof(CurvesReader));
+}
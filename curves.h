@@ -0,0 +1,138 @@
+#ifndef CURVES_H
+#define CURVES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tinyspline.h"
+#include "svg.h"
+
+#define CURVES_BINARY_MAGIC "SMCB"
+#define CURVES_BINARY_VERSION 1
+
+/**
+ * Layout of a binary curves file, as written by curves2bin:
+ *
+ *      CurvesBinaryHeader
+ *      CurvesBinaryIndex[n_strokes]
+ *      tsRational[n_values]
+ *
+ * Every stroke owns n_ctrlp*2 control point coordinates directly followed by
+ * its n_knots clamped knots, which is exactly the memory layout of
+ * tsBSpline.ctrlp/knots. A mapped stroke can therefore be evaluated in place
+ * without parsing or copying. All fields use the host byte order.
+ */
+typedef struct
+{
+  char magic[4];          /* CURVES_BINARY_MAGIC */
+  uint32_t version;       /* CURVES_BINARY_VERSION */
+  uint32_t rational_size; /* sizeof(tsRational) of the writer */
+  uint32_t reserved;
+  uint64_t n_strokes;     /* number of entries in the stroke index */
+  uint64_t n_values;      /* number of tsRational following the index */
+} CurvesBinaryHeader;
+
+typedef struct
+{
+  uint64_t offset;        /* index of the stroke's first value */
+  uint32_t n_values;      /* number of control point coordinates */
+  uint32_t n_knots;       /* number of knots following the coordinates */
+  uint32_t deg;           /* degree of the stroke's spline */
+  int32_t tool;           /* tool number of the stroke */
+} CurvesBinaryIndex;
+
+/**
+ * A single brush stroke as read from a curves file. A line of the text
+ * format looks like
+ *      <tool>; x0, y0, x1, y1, ...
+ * and describes the control points of a chain of Bezier curves.
+ *
+ * \ctrlp points into storage owned by the reader and is only valid until the
+ * next call to ::curves_next. Strokes read from a binary curves file point
+ * straight into the mapping and carry their knot vector in \knots, text
+ * strokes leave \knots NULL.
+ */
+typedef struct
+{
+  int tool;           /* tool number in front of the ';' */
+  size_t n_values;    /* number of coordinates (two per control point) */
+  tsRational* ctrlp;  /* interleaved x, y control point coordinates */
+  size_t deg;         /* degree of the stroke's spline */
+  size_t n_knots;     /* number of knots, 0 for text strokes */
+  tsRational* knots;  /* clamped knot vector following ctrlp or NULL */
+} CurvesStroke;
+
+typedef struct
+{
+  const char* map;    /* the memory mapped curves file */
+  size_t size;        /* length of the mapping in bytes */
+  size_t pos;         /* offset of the next unread line */
+  size_t line;        /* 1-based number of the last returned line/stroke */
+  const CurvesBinaryIndex* index; /* stroke index of a binary file or NULL */
+  size_t n_strokes;   /* number of entries in index */
+  int is_svg;         /* the file is an SVG document read through svg */
+  SvgReader svg;      /* path reader state of an SVG document */
+  tsRational* values; /* scratch storage handed out through CurvesStroke */
+  size_t capacity;    /* number of tsRational that fit into values */
+} CurvesReader;
+
+/**
+ * Maps \path read-only into memory and prepares \reader to walk it. Binary
+ * curves files are recognised by their magic and SVG documents by starting
+ * with '<', anything else is read as text. Every subpath of an SVG document
+ * becomes a stroke of tool 1, just like svgpreprocessor.py prints them.
+ *
+ * @return 0    on success.
+ * @return -1   if the file could not be opened or mapped, or if it is a
+ *              malformed binary curves file (errno is set).
+ */
+int curves_open(const char* path, CurvesReader* reader);
+
+/**
+ * Parses the next non-empty line of \reader into \stroke without copying the
+ * underlying text. Values are split on ';' and ',' and decoded with a locale
+ * independent float parser that yields the same value as atof for every
+ * coordinate svgpreprocessor.py emits.
+ *
+ * @return 1    if a stroke was read.
+ * @return 0    at the end of the file.
+ * @return -1   if allocating the scratch storage failed, a binary stroke
+ *              is malformed (see ::curves_stroke_at) or an SVG document is
+ *              malformed (errno is set).
+ */
+int curves_next(CurvesReader* reader, CurvesStroke* stroke);
+
+/**
+ * Random access to stroke \i of a binary curves file.
+ *
+ * @return 1    if the stroke was read.
+ * @return 0    if \i is out of range or \reader is not a binary file.
+ * @return -1   if the stroke lies outside of the file, is not of degree 1
+ *              or more, or its knots do not ascend clamped to [0, 1] (errno
+ *              is EINVAL).
+ */
+int curves_stroke_at(const CurvesReader* reader, size_t i, CurvesStroke* stroke);
+
+/**
+ * Returns the degree main uses for a stroke of \n_values coordinates: lines
+ * for up to three control points, cubic Bezier chains otherwise.
+ */
+size_t curves_stroke_degree(size_t n_values);
+
+/**
+ * Sets up \spline for \stroke. Binary strokes are borrowed straight from the
+ * mapping and must not be passed to ::ts_bspline_free, text strokes are copied
+ * into a freshly allocated clamped spline.
+ *
+ * @return 1    if \spline borrows the mapping.
+ * @return 0    if \spline owns its memory.
+ * @return the (negative) tsError of ::ts_bspline_new on error.
+ */
+int curves_stroke_spline(const CurvesStroke* stroke, tsBSpline* spline);
+
+/**
+ * Unmaps the file and frees all memory held by \reader.
+ */
+void curves_close(CurvesReader* reader);
+
+#endif // CURVES_H
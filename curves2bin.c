@@ -0,0 +1,129 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h> // Error Checking
+#include <string.h> // Required for strerror, memcpy
+
+#include "tinyspline.h"
+#include "curves.h"
+
+// Converts the text curves emitted by svgpreprocessor.py into the indexed
+// binary container described in curves.h. Each stroke is stored together with
+// the knots of its clamped spline, so the planner can map the file and
+// evaluate strokes without parsing or allocating.
+
+static void *grow(void *array, size_t *capacity, size_t needed, size_t element_size)
+{
+  if (needed <= *capacity)
+    return array;
+
+  size_t capacity_new = *capacity ? *capacity : 1024;
+  while (capacity_new < needed)
+    capacity_new *= 2;
+
+  void *array_new = realloc(array, capacity_new * element_size);
+  if (array_new == NULL)
+  {
+    fprintf(stderr,"Error: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  *capacity = capacity_new;
+  return array_new;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc != 3)
+  {
+    fprintf(stdout,"Usage: %s <curves file> <binary curves file>\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  CurvesReader reader;
+  if (curves_open(argv[1], &reader) == -1)
+  {
+    fprintf(stderr,"File Null Error <%s>: %s\n", argv[1], strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  CurvesBinaryIndex *index = NULL;
+  tsRational *values = NULL;
+  size_t n_strokes = 0, index_capacity = 0;
+  size_t n_values = 0, values_capacity = 0;
+
+  CurvesStroke stroke;
+  int status;
+  while ((status = curves_next(&reader, &stroke)) == 1)
+  {
+    // Checking Compliance for Dimensions of Control Points
+    if (stroke.n_values < 4 || stroke.n_values % 2 != 0)
+    {
+      fprintf(stderr,"Error %s:%zu: Improperly Defined Bezier Curve\n", argv[1], reader.line);
+      exit(EXIT_FAILURE);
+    }
+
+    tsBSpline spline;
+    int borrowed = curves_stroke_spline(&stroke, &spline);
+    if (borrowed < 0)
+    {
+      fprintf(stderr,"Error %s:%zu: %s\n", argv[1], reader.line, ts_enum_str(borrowed));
+      exit(EXIT_FAILURE);
+    }
+
+    // ctrlp and knots are contiguous in tsBSpline, copy them in one go
+    size_t n_stroke_values = spline.n_ctrlp * spline.dim + spline.n_knots;
+    values = grow(values, &values_capacity, n_values + n_stroke_values, sizeof(tsRational));
+    memcpy(values + n_values, spline.ctrlp, n_stroke_values * sizeof(tsRational));
+
+    index = grow(index, &index_capacity, n_strokes + 1, sizeof(CurvesBinaryIndex));
+    index[n_strokes].offset = n_values;
+    index[n_strokes].n_values = spline.n_ctrlp * spline.dim;
+    index[n_strokes].n_knots = spline.n_knots;
+    index[n_strokes].deg = spline.deg;
+    index[n_strokes].tool = stroke.tool;
+
+    n_strokes++;
+    n_values += n_stroke_values;
+
+    if (!borrowed)
+      ts_bspline_free(&spline);
+  }
+
+  if (status == -1)
+  {
+    fprintf(stderr,"Error %s:%zu: %s\n", argv[1], reader.line, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  FILE *binary = fopen(argv[2], "wb");
+  if (binary == NULL)
+  {
+    fprintf(stderr,"File Null Error <%s>: %s\n", argv[2], strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  CurvesBinaryHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CURVES_BINARY_MAGIC, 4);
+  header.version = CURVES_BINARY_VERSION;
+  header.rational_size = sizeof(tsRational);
+  header.n_strokes = n_strokes;
+  header.n_values = n_values;
+
+  if (fwrite(&header, sizeof(header), 1, binary) != 1 ||
+      fwrite(index, sizeof(CurvesBinaryIndex), n_strokes, binary) != n_strokes ||
+      fwrite(values, sizeof(tsRational), n_values, binary) != n_values ||
+      fclose(binary) != 0)
+  {
+    fprintf(stderr,"Error: File Write Operation\n");
+    exit(EXIT_FAILURE);
+  }
+
+  printf("Converted <%zu> strokes from <%s> into <%s>.\n", n_strokes, argv[1], argv[2]);
+
+  // Clean Up
+  curves_close(&reader);
+  free(index);
+  free(values);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,170 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h> // Error Checking
+#include <string.h> // Required for strerror, memcmp
+#include <math.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "tinyspline.h"
+#include "curves.h"
+
+// Times the CurvesReader on a text curves file against the loop main read it
+// with before, fgets into a line buffer, strtok on ';' and ',' and atof, and
+// checks that both decode the same values. Reports the best of a few rounds
+// in MB/s of the file.
+
+#define MaxTextExtent 4096 /* the line buffer of the old loop */
+#define BenchRounds 5      /* the fastest one counts */
+
+typedef struct
+{
+  tsRational* values;
+  size_t n_values, capacity;
+  size_t n_strokes;
+} Values;
+
+static double now(void)
+{
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static void append(Values* values, tsRational value)
+{
+  if (values->n_values == values->capacity)
+  {
+    size_t capacity_new = values->capacity ? 2 * values->capacity : 1024;
+    tsRational* values_new = realloc(values->values, capacity_new * sizeof(tsRational));
+    if (values_new == NULL)
+    {
+      fprintf(stderr,"Error: %s\n", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+    values->values = values_new;
+    values->capacity = capacity_new;
+  }
+  values->values[values->n_values++] = value;
+}
+
+// The parser of main before the CurvesReader, lines of any length
+// concatenated from fgets
+static void read_atof(const char* path, Values* values)
+{
+  FILE* file = fopen(path, "r");
+  if (file == NULL)
+  {
+    fprintf(stderr,"File Null Error <%s>: %s\n", path, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  char buffer[MaxTextExtent];
+  char* ret = NULL;
+  size_t full_length = 0;
+  while (fgets(buffer, sizeof(buffer), file))
+  {
+    size_t len = strlen(buffer);
+    char* r_temp = realloc(ret, full_length + len + 1);
+    if (r_temp == NULL)
+    {
+      fprintf(stderr,"Error: %s\n", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+    ret = r_temp;
+    strcpy(ret + full_length, buffer); /* concatenate */
+    full_length += len;
+    if (!feof(file) && buffer[len-1] != '\n')
+      continue;
+
+    char* new_line_char = strchr(ret, '\n');
+    if (new_line_char != NULL)
+      *new_line_char = '\0';
+
+    char* pt = strtok(ret, ";");
+    if (pt != NULL && (pt = strtok(NULL, ",")) != NULL)
+    {
+      values->n_strokes++;
+      for (; pt != NULL; pt = strtok(NULL, ","))
+        append(values, atof(pt));
+    }
+    full_length = 0;
+  }
+
+  free(ret);
+  fclose(file);
+}
+
+static void read_curves(const char* path, Values* values)
+{
+  CurvesReader reader;
+  if (curves_open(path, &reader) == -1)
+  {
+    fprintf(stderr,"File Null Error <%s>: %s\n", path, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  CurvesStroke stroke;
+  int status;
+  while ((status = curves_next(&reader, &stroke)) == 1)
+  {
+    values->n_strokes++;
+    for (size_t i = 0; i < stroke.n_values; i++)
+      append(values, stroke.ctrlp[i]);
+  }
+  if (status == -1)
+  {
+    fprintf(stderr,"Error: Curves <%s> line %zu: %s\n", path, reader.line, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  curves_close(&reader);
+}
+
+int main(int argc, char** argv)
+{
+  if (argc != 2)
+  {
+    fprintf(stdout,"Usage: %s <curves file>\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  struct stat info;
+  if (stat(argv[1], &info) == -1)
+  {
+    fprintf(stderr,"File Null Error <%s>: %s\n", argv[1], strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  const double megabytes = info.st_size / 1e6;
+
+  Values old = {NULL, 0, 0, 0}, new = {NULL, 0, 0, 0};
+  double time_old = INFINITY, time_new = INFINITY, start;
+  for (int round = 0; round < BenchRounds; round++)
+  {
+    old.n_values = old.n_strokes = 0;
+    start = now();
+    read_atof(argv[1], &old);
+    time_old = fmin(time_old, now() - start);
+
+    new.n_values = new.n_strokes = 0;
+    start = now();
+    read_curves(argv[1], &new);
+    time_new = fmin(time_new, now() - start);
+  }
+
+  fprintf(stdout,"<%s> %.1f MB, %zu strokes, %zu values\n", argv[1], megabytes, new.n_strokes, new.n_values);
+  fprintf(stdout,"fgets, strtok, atof: %8.1f MB/s\n", megabytes / time_old);
+  fprintf(stdout,"curves_next:         %8.1f MB/s, %.1fx\n", megabytes / time_new, time_old / time_new);
+
+  int status = EXIT_SUCCESS;
+  if (old.n_strokes != new.n_strokes || old.n_values != new.n_values
+    || memcmp(old.values, new.values, new.n_values * sizeof(tsRational)) != 0)
+  {
+    fprintf(stderr,"Error: the readers decoded different values\n");
+    status = EXIT_FAILURE;
+  }
+
+  free(old.values);
+  free(new.values);
+  return status;
+}
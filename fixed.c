@@ -0,0 +1,176 @@
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "fixed.h"
+
+#define FIXED_MAX_NET 32          /* values of the de Boor net, order times dim */
+#define FIXED_CORDIC_BITS 40      /* magnitude the CORDIC vector is scaled to */
+#define FIXED_CORDIC_ITERATIONS 31
+#define FIXED_HALF_PI 1686629713  /* pi/2 with FIXED_PARAMETER_SHIFT fraction bits */
+
+// atan(2^-i) with FIXED_PARAMETER_SHIFT fraction bits
+static const int64_t fixed_cordic_angles[FIXED_CORDIC_ITERATIONS] = {
+  843314857, 497837829, 263043837, 133525159, 67021687, 33543516, 16775851, 8388437,
+  4194283, 2097149, 1048576, 524288, 262144, 131072, 65536, 32768,
+  16384, 8192, 4096, 2048, 1024, 512, 256, 128,
+  64, 32, 16, 8, 4, 2, 1
+};
+
+Fixed fixed_from_float(double value)
+{
+  return lround(value * FIXED_ONE);
+}
+
+float fixed_to_float(Fixed value)
+{
+  return (float) value / FIXED_ONE;
+}
+
+int fixed_bspline_init(FixedBSpline* fixed, const tsBSpline* spline, Arena* arena)
+{
+  size_t i;
+
+  if (spline->order * spline->dim > FIXED_MAX_NET)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+  fixed->deg = spline->deg;
+  fixed->dim = spline->dim;
+  fixed->n_ctrlp = spline->n_ctrlp;
+  fixed->n_knots = spline->n_knots;
+  fixed->ctrlp = arena_alloc(arena, sizeof(Fixed) * spline->n_ctrlp * spline->dim);
+  fixed->knots = arena_alloc(arena, sizeof(FixedParameter) * spline->n_knots);
+  if (fixed->ctrlp == NULL || fixed->knots == NULL)
+    return -1;
+
+  for (i = 0; i < spline->n_ctrlp * spline->dim; i++)
+    fixed->ctrlp[i] = fixed_from_float(spline->ctrlp[i]);
+  for (i = 0; i < spline->n_knots; i++)
+    fixed->knots[i] = lround(spline->knots[i] * (double) FIXED_PARAMETER_ONE);
+  return 0;
+}
+
+void fixed_bspline_evaluate_many(const FixedBSpline* spline, const FixedParameter* us, size_t n, Fixed* points)
+{
+  const size_t deg = spline->deg, dim = spline->dim;
+  const size_t last = spline->n_ctrlp - 1; // the last span that is not empty
+  Fixed net[FIXED_MAX_NET];
+  size_t i, j, k, d, r;
+
+  for (i = 0; i < n; i++)
+  {
+    FixedParameter u = us[i];
+    if (u < spline->knots[deg])
+      u = spline->knots[deg];
+    if (u > spline->knots[last + 1])
+      u = spline->knots[last + 1];
+
+    // The span [knots[k], knots[k+1]) holding u
+    size_t low = deg, high = last;
+    while (low < high)
+    {
+      size_t middle = (low + high + 1) / 2;
+      if (spline->knots[middle] <= u)
+        low = middle;
+      else
+        high = middle - 1;
+    }
+    k = low;
+
+    for (j = 0; j <= deg; j++)
+    {
+      for (d = 0; d < dim; d++)
+        net[j * dim + d] = spline->ctrlp[(k - deg + j) * dim + d];
+    }
+    for (r = 1; r <= deg; r++)
+    {
+      for (j = deg; j >= r; j--)
+      {
+        const size_t first = k - deg + j;
+        const int64_t span = spline->knots[first + deg + 1 - r] - spline->knots[first];
+        const int64_t alpha = span > 0 ? ((int64_t) (u - spline->knots[first]) << FIXED_PARAMETER_SHIFT) / span : 0;
+        for (d = 0; d < dim; d++)
+        {
+          const int64_t delta = net[j * dim + d] - net[(j - 1) * dim + d];
+          net[j * dim + d] = net[(j - 1) * dim + d]
+            + ((delta * alpha + (1 << (FIXED_PARAMETER_SHIFT - 1))) >> FIXED_PARAMETER_SHIFT);
+        }
+      }
+    }
+    for (d = 0; d < dim; d++)
+      points[i * dim + d] = net[deg * dim + d];
+  }
+}
+
+int64_t fixed_atan2(int64_t y, int64_t x)
+{
+  int64_t angle = 0, t;
+  int i, shift;
+
+  if (x == 0 && y == 0)
+    return 0;
+
+  // Scale the larger coordinate to FIXED_CORDIC_BITS bits, the shifts of the
+  // iterations then keep enough of them and the gain of 1.65 cannot overflow
+  shift = 64 - __builtin_clzll(llabs(x) | llabs(y)) - FIXED_CORDIC_BITS;
+  if (shift > 0)
+  {
+    x >>= shift;
+    y >>= shift;
+  }
+  else
+  {
+    x *= (int64_t) 1 << -shift;
+    y *= (int64_t) 1 << -shift;
+  }
+
+  // Rotate into the right half plane by a quarter turn
+  if (x < 0)
+  {
+    t = x;
+    if (y >= 0)
+    {
+      x = y;
+      y = -t;
+      angle = FIXED_HALF_PI;
+    }
+    else
+    {
+      x = -y;
+      y = t;
+      angle = -FIXED_HALF_PI;
+    }
+  }
+
+  // Rotate onto the x axis by ever smaller angles, towards it from either
+  // side: the mask negates the steps below the axis without a branch, which
+  // the processor could only guess
+  for (i = 0; i < FIXED_CORDIC_ITERATIONS; i++)
+  {
+    const int64_t below = -(int64_t) (y <= 0);
+    t = x;
+    x += ((y >> i) ^ below) - below;
+    y -= ((t >> i) ^ below) - below;
+    angle += (fixed_cordic_angles[i] ^ below) - below;
+  }
+  return angle;
+}
+
+uint64_t fixed_sqrt(uint64_t value)
+{
+  uint64_t root = 0, bit = (uint64_t) 1 << 62;
+
+  while (bit > value)
+    bit >>= 2;
+  while (bit != 0)
+  {
+    // Take the bit where it fits, masked like the CORDIC steps
+    const uint64_t fits = -(uint64_t) (value >= root + bit);
+    value -= (root + bit) & fits;
+    root = (root >> 1) + (bit & fits);
+    bit >>= 2;
+  }
+  return root;
+}
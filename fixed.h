@@ -0,0 +1,73 @@
+#ifndef FIXED_H
+#define FIXED_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "tinyspline.h"
+
+#define FIXED_SHIFT 16                    /* fraction bits of Fixed */
+#define FIXED_ONE (1 << FIXED_SHIFT)
+#define FIXED_PARAMETER_SHIFT 30          /* fraction bits of FixedParameter and angles */
+#define FIXED_PARAMETER_ONE (1 << FIXED_PARAMETER_SHIFT)
+
+/* A constant as Fixed, folded by the compiler so no float is left at run time */
+#define FIXED_CONSTANT(c) ((Fixed) ((c) * FIXED_ONE + ((c) >= 0 ? 0.5 : -0.5)))
+
+typedef int32_t Fixed;          /* Q16.16, pen positions in points or inches */
+typedef int32_t FixedParameter; /* Q2.30, spline parameters in [0, 1] */
+
+/**
+ * A B-spline with its knots as FixedParameter and its control points as
+ * Fixed, evaluated without floating point.
+ */
+typedef struct
+{
+  size_t deg;
+  size_t dim;
+  size_t n_ctrlp;
+  size_t n_knots;
+  Fixed* ctrlp;
+  FixedParameter* knots;
+} FixedBSpline;
+
+/**
+ * Returns \value rounded to the nearest Fixed.
+ */
+Fixed fixed_from_float(double value);
+
+/**
+ * Returns \value as a float, for bookkeeping outside the fixed-point path.
+ */
+float fixed_to_float(Fixed value);
+
+/**
+ * Sets up \fixed as a copy of \spline, whose knots must lie in [0, 1], with
+ * the arrays taken from \arena.
+ *
+ * @return 0    on success.
+ * @return -1   if the arena could not allocate the arrays (errno is set).
+ */
+int fixed_bspline_init(FixedBSpline* fixed, const tsBSpline* spline, Arena* arena);
+
+/**
+ * Evaluates \spline at the \n parameters \us with de Boor's algorithm and
+ * stores the points one after another in \points, \spline->dim values each.
+ * Parameters past the last knot evaluate to the last control point.
+ */
+void fixed_bspline_evaluate_many(const FixedBSpline* spline, const FixedParameter* us, size_t n, Fixed* points);
+
+/**
+ * Returns the angle of the vector \x, \y in (-pi, pi] radians with
+ * FIXED_PARAMETER_SHIFT fraction bits, by CORDIC in vectoring mode. \x and
+ * \y may have any common scale. The angle is within 1e-8 rad of atan2.
+ */
+int64_t fixed_atan2(int64_t y, int64_t x);
+
+/**
+ * Returns the square root of \value rounded down.
+ */
+uint64_t fixed_sqrt(uint64_t value);
+
+#endif // FIXED_H
@@ -0,0 +1,619 @@
+#include <stdlib.h>
+#include <math.h>
+#include <float.h>
+#include "kinematics.h"
+
+// The vector kernels load tsRational as float, a double precision build
+// solves one point at a time
+#if defined(__SSE2__) && !defined(TINYSPLINE_DOUBLE_PRECISION)
+#define KINEMATICS_SIMD
+#include <immintrin.h>
+#endif
+
+// Odd minimax polynomial of atan on [0, 1], below 1e-5 rad of error
+#define KINEMATICS_ATAN_C1 0.99997726f
+#define KINEMATICS_ATAN_C3 -0.33262347f
+#define KINEMATICS_ATAN_C5 0.19354346f
+#define KINEMATICS_ATAN_C7 -0.11643287f
+#define KINEMATICS_ATAN_C9 0.05265332f
+#define KINEMATICS_ATAN_C11 -0.01172120f
+
+#define KINEMATICS_LANES 4 /* points of an SSE vector, the AVX2 kernel does two at once */
+
+#define KINEMATICS_STEP_MAX 0.5     /* inches a sample may move and still be solved incrementally */
+#define KINEMATICS_NEWTON_TURN 0.002 /* rad the joints may turn in a single Newton step, about a step */
+#define KINEMATICS_NEWTON_STEPS 3    /* Newton steps per point before it is solved from scratch */
+#define KINEMATICS_SINGULAR 0.02     /* |sin theta2| below which the arm is solved exactly */
+
+/**
+ * The joint angles of the incremental solver in radians, with the cosine and
+ * sine of theta1, theta2 and theta1 + theta2 turned along with them, and how
+ * far the joints turned onto the last point.
+ */
+typedef struct
+{
+  double theta1, theta2;
+  double c1, s1, c2, s2, c12, s12;
+  double turn1, turn2;
+} KinematicsState;
+
+void kinematics_inverse(tsRational x, tsRational y, Elbow elbow, tsRational* joint1, tsRational* joint2)
+{
+  float theta1, theta2, r;
+
+  r = (pow(x,2)+pow(y,2)-pow(ShoulderPanLinkLength,2)-pow(ElbowPanLinkLength,2))/(2*ShoulderPanLinkLength*ElbowPanLinkLength);
+  theta2 = atan2(sqrt(1-pow(r,2)),r);
+  if (elbow == ELBOW_NEGATIVE)
+    theta2 = -theta2;
+  theta1 = atan2(y, x) - atan2(ElbowPanLinkLength*sin(theta2), ShoulderPanLinkLength+ElbowPanLinkLength*cos(theta2));
+
+  *joint1 = roundf(theta1*StepsPerRadian);
+  *joint2 = roundf(theta2*StepsPerRadian);
+}
+
+void kinematics_forward(double theta1, double theta2, double link1, double link2, double* x, double* y)
+{
+  const double angle1 = theta1 / StepsPerRadian, angle12 = (theta1 + theta2) / StepsPerRadian;
+  *x = link1 * cos(angle1) + link2 * cos(angle12);
+  *y = link1 * sin(angle1) + link2 * sin(angle12);
+}
+
+// An angle with FIXED_PARAMETER_SHIFT fraction bits in steps, rounded half
+// away from zero like roundf
+static int kinematics_fixed_steps(int64_t angle)
+{
+  const int shift = FIXED_PARAMETER_SHIFT + FIXED_SHIFT;
+  const int64_t steps = angle * FIXED_CONSTANT(StepsPerRadian), half = (int64_t) 1 << (shift - 1);
+  return steps >= 0 ? (steps + half) >> shift : -((-steps + half) >> shift);
+}
+
+void kinematics_inverse_fixed(Fixed x, Fixed y, Elbow elbow, int* theta1, int* theta2)
+{
+  const int64_t l1 = FIXED_CONSTANT(ShoulderPanLinkLength), l2 = FIXED_CONSTANT(ElbowPanLinkLength);
+  const int64_t one = FIXED_PARAMETER_ONE;
+
+  // The cosine of theta2 with FIXED_PARAMETER_SHIFT fraction bits, from the
+  // squares with twice FIXED_SHIFT
+  int64_t r = ((int64_t) x * x + (int64_t) y * y - l1 * l1 - l2 * l2) * (1 << (FIXED_PARAMETER_SHIFT - FIXED_SHIFT))
+    / (2 * l1 * l2 >> FIXED_SHIFT);
+  if (r > one)
+    r = one;
+  if (r < -one)
+    r = -one;
+  int64_t s = fixed_sqrt(one * one - r * r);
+  if (elbow == ELBOW_NEGATIVE)
+    s = -s;
+
+  int64_t angle2 = fixed_atan2(s, r);
+  int64_t angle1 = fixed_atan2(y, x) - fixed_atan2(l2 * s, l1 * one + l2 * r);
+  *theta1 = kinematics_fixed_steps(angle1);
+  *theta2 = kinematics_fixed_steps(angle2);
+}
+
+// Solves the arm at x, y from scratch like kinematics_inverse, the cosines and
+// sines from the geometry rather than from the angles, returns 0 if the
+// position is out of reach
+static int kinematics_anchor(double x, double y, Elbow elbow, KinematicsState* state)
+{
+  state->c2 = (x*x + y*y - ShoulderPanLinkLength*ShoulderPanLinkLength - ElbowPanLinkLength*ElbowPanLinkLength)
+    / (2*ShoulderPanLinkLength*ElbowPanLinkLength);
+  state->s2 = sqrt(1 - state->c2 * state->c2);
+  if (elbow == ELBOW_NEGATIVE)
+    state->s2 = -state->s2;
+
+  // The arm is the vector k turned by theta1
+  const double k1 = ShoulderPanLinkLength + ElbowPanLinkLength * state->c2, k2 = ElbowPanLinkLength * state->s2;
+  const double k = k1*k1 + k2*k2;
+  state->theta2 = atan2(state->s2, state->c2);
+  state->theta1 = atan2(y, x) - atan2(k2, k1);
+  state->c1 = (x * k1 + y * k2) / k;
+  state->s1 = (y * k1 - x * k2) / k;
+  state->c12 = state->c1 * state->c2 - state->s1 * state->s2;
+  state->s12 = state->s1 * state->c2 + state->c1 * state->s2;
+  state->turn1 = state->turn2 = 0;
+  return !isnan(state->theta2);
+}
+
+// Turns the unit vector c, s by the small angle of a step, the series is
+// exact to angle^6 / 720
+static inline void kinematics_rotate(double* c, double* s, double angle)
+{
+  const double a2 = angle * angle;
+  const double cosine = 1 - a2 * (0.5 - a2 / 24), sine = angle * (1 - a2 * (1.0 / 6 - a2 / 120));
+  const double t = *c;
+  *c = t * cosine - *s * sine;
+  *s = *s * cosine + t * sine;
+}
+
+// Turns the joints by d1, d2
+static inline void kinematics_turn(KinematicsState* state, double d1, double d2)
+{
+  state->theta1 += d1;
+  state->theta2 += d2;
+  kinematics_rotate(&state->c1, &state->s1, d1);
+  kinematics_rotate(&state->c2, &state->s2, d2);
+  kinematics_rotate(&state->c12, &state->s12, d1 + d2);
+}
+
+// One Newton step of the joints towards the pen position x, y through the
+// inverse of the arm's Jacobian, whose determinant is L1 L2 sin(theta2),
+// returns how far the joints turned
+static inline double kinematics_newton(double x, double y, KinematicsState* state)
+{
+  const double px = ShoulderPanLinkLength * state->c1 + ElbowPanLinkLength * state->c12;
+  const double py = ShoulderPanLinkLength * state->s1 + ElbowPanLinkLength * state->s12;
+  const double ex = x - px, ey = y - py;
+  const double inverse = 1 / (ShoulderPanLinkLength * ElbowPanLinkLength * state->s2);
+  const double d1 = ElbowPanLinkLength * (state->c12 * ex + state->s12 * ey) * inverse;
+  const double d2 = -(px * ex + py * ey) * inverse;
+
+  kinematics_turn(state, d1, d2);
+  return fabs(d1) + fabs(d2);
+}
+
+void kinematics_inverse_incremental(const tsRational* x, const tsRational* y, size_t n, Elbow elbow, size_t interval,
+  tsRational* theta1, tsRational* theta2)
+{
+  KinematicsState state;
+  int valid = 0;
+  size_t i;
+
+  for (i = 0; i < n; i++)
+  {
+    const double dx = i > 0 ? x[i] - x[i-1] : 0, dy = i > 0 ? y[i] - y[i-1] : 0;
+    int k;
+
+    // Crossing the negative x axis turns atan2(y, x) by a whole turn, which
+    // the exact solution follows and the steps would not
+    const int wraps = i > 0 && (x[i] < 0 || x[i-1] < 0) && signbit(y[i]) != signbit(y[i-1]);
+
+    if (!valid || (interval > 0 && i % interval == 0) || dx*dx + dy*dy > KINEMATICS_STEP_MAX * KINEMATICS_STEP_MAX
+      || fabs(state.s2) < KINEMATICS_SINGULAR || wraps)
+    {
+      valid = kinematics_anchor(x[i], y[i], elbow, &state);
+    }
+    else
+    {
+      // Guess the joints turn on as they did onto the last point, samples
+      // come evenly spaced. The error left by a Newton step is about the
+      // square of its turn, correct until that is far below a step or give
+      // up on the guess. So does a guess that ends up in the other elbow
+      // configuration or close to the singularity between them.
+      const double theta1_last = state.theta1, theta2_last = state.theta2;
+      kinematics_turn(&state, state.turn1, state.turn2);
+      for (k = 0; k < KINEMATICS_NEWTON_STEPS && kinematics_newton(x[i], y[i], &state) > KINEMATICS_NEWTON_TURN; k++)
+        ;
+      if (k == KINEMATICS_NEWTON_STEPS || fabs(state.s2) < KINEMATICS_SINGULAR
+        || (state.s2 < 0) != (elbow == ELBOW_NEGATIVE))
+      {
+        valid = kinematics_anchor(x[i], y[i], elbow, &state);
+      }
+      else
+      {
+        state.turn1 = state.theta1 - theta1_last;
+        state.turn2 = state.theta2 - theta2_last;
+      }
+    }
+
+    theta1[i] = roundf(state.theta1 * StepsPerRadian);
+    theta2[i] = roundf(state.theta2 * StepsPerRadian);
+  }
+}
+
+// The exact angles in steps, unrounded
+static void kinematics_angles(double x, double y, Elbow elbow, double* theta1, double* theta2)
+{
+  double r = (x*x + y*y - ShoulderPanLinkLength*ShoulderPanLinkLength - ElbowPanLinkLength*ElbowPanLinkLength)
+    / (2*ShoulderPanLinkLength*ElbowPanLinkLength);
+  double angle = atan2(sqrt(1 - r*r), r);
+  if (elbow == ELBOW_NEGATIVE)
+    angle = -angle;
+  *theta2 = angle * StepsPerRadian;
+  *theta1 = (atan2(y, x) - atan2(ElbowPanLinkLength*sin(angle), ShoulderPanLinkLength + ElbowPanLinkLength*cos(angle)))
+    * StepsPerRadian;
+}
+
+// Bilinear interpolation of angle k at fx, fy within the cell whose first
+// node is at node
+static inline float kinematics_grid_blend(const float* node, size_t columns, int k, float fx, float fy)
+{
+  const float* above = node + columns * 2;
+  return (1 - fy) * ((1 - fx) * node[k] + fx * node[2 + k]) + fy * ((1 - fx) * above[k] + fx * above[2 + k]);
+}
+
+int kinematics_grid_new(KinematicsGrid* grid, double x0, double y0, double x1, double y1, double spacing,
+  double tolerance)
+{
+  size_t row, column;
+  int elbow, k, probe;
+
+  grid->x0 = x0;
+  grid->y0 = y0;
+  grid->spacing = spacing;
+  grid->columns = (size_t) ceil((x1 - x0) / spacing) + 1;
+  grid->rows = (size_t) ceil((y1 - y0) / spacing) + 1;
+
+  const size_t n_cells = (grid->columns - 1) * (grid->rows - 1);
+  for (elbow = 0; elbow < KINEMATICS_ELBOWS; elbow++)
+  {
+    grid->nodes[elbow] = malloc(sizeof(float) * 2 * grid->columns * grid->rows);
+    grid->exact[elbow] = malloc(n_cells);
+  }
+  for (elbow = 0; elbow < KINEMATICS_ELBOWS; elbow++)
+  {
+    if (grid->nodes[elbow] == NULL || grid->exact[elbow] == NULL)
+    {
+      kinematics_grid_free(grid);
+      return -1;
+    }
+  }
+
+  for (elbow = 0; elbow < KINEMATICS_ELBOWS; elbow++)
+  {
+    float* nodes = grid->nodes[elbow];
+    for (row = 0; row < grid->rows; row++)
+    {
+      for (column = 0; column < grid->columns; column++)
+      {
+        double theta1, theta2;
+        kinematics_angles(x0 + column * spacing, y0 + row * spacing, elbow, &theta1, &theta2);
+        nodes[(row * grid->columns + column) * 2] = theta1;
+        nodes[(row * grid->columns + column) * 2 + 1] = theta2;
+      }
+    }
+
+    // The centre and the middle of every edge, as fractions of the cell
+    static const float probes[5][2] = {{0.5f, 0.5f}, {0.5f, 0}, {0.5f, 1}, {0, 0.5f}, {1, 0.5f}};
+    grid->n_exact[elbow] = 0;
+    for (row = 0; row + 1 < grid->rows; row++)
+    {
+      for (column = 0; column + 1 < grid->columns; column++)
+      {
+        const float* node = nodes + (row * grid->columns + column) * 2;
+        int exact = 0;
+        for (probe = 0; probe < 5 && !exact; probe++)
+        {
+          double theta[2];
+          kinematics_angles(x0 + (column + probes[probe][0]) * spacing, y0 + (row + probes[probe][1]) * spacing,
+            elbow, &theta[0], &theta[1]);
+          for (k = 0; k < 2; k++)
+          {
+            // NaN nodes beyond the reach fail the comparison too
+            if (!(fabs(kinematics_grid_blend(node, grid->columns, k, probes[probe][0], probes[probe][1]) - theta[k]) <= tolerance))
+              exact = 1;
+          }
+        }
+        grid->exact[elbow][row * (grid->columns - 1) + column] = exact;
+        grid->n_exact[elbow] += exact;
+      }
+    }
+  }
+  return 0;
+}
+
+void kinematics_grid_free(KinematicsGrid* grid)
+{
+  int elbow;
+  for (elbow = 0; elbow < KINEMATICS_ELBOWS; elbow++)
+  {
+    free(grid->nodes[elbow]);
+    free(grid->exact[elbow]);
+    grid->nodes[elbow] = NULL;
+    grid->exact[elbow] = NULL;
+  }
+}
+
+void kinematics_grid_inverse(const KinematicsGrid* grid, const tsRational* x, const tsRational* y, size_t n,
+  Elbow elbow, tsRational* theta1, tsRational* theta2)
+{
+  const float scale = 1 / grid->spacing;
+  const float* nodes = grid->nodes[elbow];
+  const unsigned char* exact = grid->exact[elbow];
+  size_t i;
+
+  for (i = 0; i < n; i++)
+  {
+    float gx = (x[i] - grid->x0) * scale, gy = (y[i] - grid->y0) * scale;
+    if (gx >= 0 && gy >= 0 && gx < grid->columns - 1 && gy < grid->rows - 1)
+    {
+      size_t column = (size_t) gx, row = (size_t) gy;
+      if (!exact[row * (grid->columns - 1) + column])
+      {
+        const float* node = nodes + (row * grid->columns + column) * 2;
+        float fx = gx - column, fy = gy - row;
+        theta1[i] = roundf(kinematics_grid_blend(node, grid->columns, 0, fx, fy));
+        theta2[i] = roundf(kinematics_grid_blend(node, grid->columns, 1, fx, fy));
+        continue;
+      }
+    }
+    kinematics_inverse(x[i], y[i], elbow, &theta1[i], &theta2[i]);
+  }
+}
+
+static inline int kinematics_outside(const tsRational joint[2], const KinematicsLimits* limits)
+{
+  return joint[0] < limits->min[0] || joint[0] > limits->max[0] || joint[1] < limits->min[1] || joint[1] > limits->max[1];
+}
+
+void kinematics_entry(KinematicsStroke* stroke, float prev_x, float prev_y, const KinematicsLimits* limits)
+{
+  tsRational from[KINEMATICS_ELBOWS][2], to[KINEMATICS_ELBOWS][2];
+  int before, after;
+
+  for (after = 0; after < KINEMATICS_ELBOWS; after++)
+  {
+    kinematics_inverse(stroke->first[0], stroke->first[1], after, &to[after][0], &to[after][1]);
+    stroke->entry_outside[after] = 0;
+    if (prev_x != -1)
+    {
+      kinematics_inverse(prev_x, prev_y, after, &from[after][0], &from[after][1]);
+      stroke->entry_outside[after] = kinematics_outside(from[after], limits);
+    }
+  }
+  for (before = 0; before < KINEMATICS_ELBOWS; before++)
+  {
+    for (after = 0; after < KINEMATICS_ELBOWS; after++)
+    {
+      stroke->entry[before][after] = prev_x == -1 ? 0
+        : fabs(to[after][0] - from[before][0]) + fabs(to[after][1] - from[before][1]);
+    }
+  }
+}
+
+void kinematics_evaluate(const tsRational* x, const tsRational* y, size_t n, float prev_x, float prev_y,
+  const KinematicsLimits* limits, KinematicsStroke* stroke)
+{
+  int elbow;
+  size_t i;
+
+  for (elbow = 0; elbow < KINEMATICS_ELBOWS; elbow++)
+  {
+    tsRational last[2] = {0, 0};
+    stroke->travel[elbow] = 0;
+    stroke->outside[elbow] = 0;
+    for (i = 0; i < n; i++)
+    {
+      tsRational joint[2];
+      kinematics_inverse(x[i], y[i], elbow, &joint[0], &joint[1]);
+      if (i > 0)
+        stroke->travel[elbow] += fabs(joint[0] - last[0]) + fabs(joint[1] - last[1]);
+      stroke->outside[elbow] += kinematics_outside(joint, limits);
+      last[0] = joint[0];
+      last[1] = joint[1];
+    }
+  }
+  if (n == 0)
+  {
+    stroke->first[0] = prev_x;
+    stroke->first[1] = prev_y;
+  }
+  else
+  {
+    stroke->first[0] = x[0];
+    stroke->first[1] = y[0];
+  }
+  kinematics_entry(stroke, prev_x, prev_y, limits);
+}
+
+Elbow kinematics_choose(const KinematicsStroke* stroke, int previous, int lifted, const KinematicsLimits* limits)
+{
+  double cost[KINEMATICS_ELBOWS];
+  int elbow;
+
+  // Turning the elbow over would drag the pen across the paper
+  if (previous != -1 && !lifted)
+    return previous;
+
+  // The elbow turns over in the pen-up frames at the previous pen position
+  for (elbow = 0; elbow < KINEMATICS_ELBOWS; elbow++)
+  {
+    cost[elbow] = stroke->outside[elbow] > 0 || (previous != -1 && elbow != previous && stroke->entry_outside[elbow])
+      ? INFINITY : stroke->travel[elbow] + stroke->entry[previous == -1 ? elbow : previous][elbow];
+  }
+
+  if (previous == -1)
+  {
+    if (isinf(cost[ELBOW_POSITIVE]) && isinf(cost[ELBOW_NEGATIVE]))
+      return ELBOW_POSITIVE;
+    return cost[ELBOW_NEGATIVE] < cost[ELBOW_POSITIVE] ? ELBOW_NEGATIVE : ELBOW_POSITIVE;
+  }
+
+  const int other = !previous;
+  if (!isinf(cost[other]) && cost[other] + limits->hysteresis < cost[previous])
+    return other;
+  return previous;
+}
+
+// The kernels share one sequence of single precision operations without
+// fused multiply-adds, so every lane and every instruction set rounds the
+// same way. Unreachable points give NaN like the exact solution.
+
+#ifdef KINEMATICS_SIMD
+
+_Static_assert(sizeof(tsRational) == sizeof(float), "the SSE and AVX2 kernels load tsRational as float");
+
+static inline __m128 kinematics_atan2_sse(__m128 y, __m128 x)
+{
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  __m128 ax = _mm_andnot_ps(sign, x), ay = _mm_andnot_ps(sign, y);
+  __m128 a = _mm_div_ps(_mm_min_ps(ax, ay), _mm_max_ps(_mm_max_ps(ax, ay), _mm_set1_ps(FLT_MIN)));
+  __m128 a2 = _mm_mul_ps(a, a);
+
+  __m128 p = _mm_set1_ps(KINEMATICS_ATAN_C11);
+  p = _mm_add_ps(_mm_mul_ps(p, a2), _mm_set1_ps(KINEMATICS_ATAN_C9));
+  p = _mm_add_ps(_mm_mul_ps(p, a2), _mm_set1_ps(KINEMATICS_ATAN_C7));
+  p = _mm_add_ps(_mm_mul_ps(p, a2), _mm_set1_ps(KINEMATICS_ATAN_C5));
+  p = _mm_add_ps(_mm_mul_ps(p, a2), _mm_set1_ps(KINEMATICS_ATAN_C3));
+  p = _mm_add_ps(_mm_mul_ps(p, a2), _mm_set1_ps(KINEMATICS_ATAN_C1));
+  p = _mm_mul_ps(p, a);
+
+  // Unfold the octant, then the half plane and the sign of y
+  __m128 swap = _mm_cmpgt_ps(ay, ax);
+  p = _mm_or_ps(_mm_and_ps(swap, _mm_sub_ps(_mm_set1_ps(M_PI_2), p)), _mm_andnot_ps(swap, p));
+  __m128 left = _mm_cmplt_ps(x, _mm_setzero_ps());
+  p = _mm_or_ps(_mm_and_ps(left, _mm_sub_ps(_mm_set1_ps(M_PI), p)), _mm_andnot_ps(left, p));
+  return _mm_xor_ps(p, _mm_and_ps(y, sign));
+}
+
+// roundf of theta in encoder steps, halves away from zero
+static inline __m128 kinematics_steps_sse(__m128 theta)
+{
+  __m128 v = _mm_mul_ps(theta, _mm_set1_ps(StepsPerRadian));
+  __m128 half = _mm_or_ps(_mm_and_ps(v, _mm_set1_ps(-0.0f)), _mm_set1_ps(0.5f));
+  return _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_add_ps(v, half)));
+}
+
+static inline void kinematics_inverse_sse(const tsRational* x, const tsRational* y, float elbow,
+  tsRational* joint1, tsRational* joint2)
+{
+  const __m128 l1 = _mm_set1_ps(ShoulderPanLinkLength), l2 = _mm_set1_ps(ElbowPanLinkLength);
+  __m128 vx = _mm_loadu_ps(x), vy = _mm_loadu_ps(y);
+
+  __m128 r = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)),
+    _mm_set1_ps(ShoulderPanLinkLength*ShoulderPanLinkLength + ElbowPanLinkLength*ElbowPanLinkLength)),
+    _mm_set1_ps(1 / (2*ShoulderPanLinkLength*ElbowPanLinkLength)));
+  __m128 s = _mm_mul_ps(_mm_sqrt_ps(_mm_sub_ps(_mm_set1_ps(1), _mm_mul_ps(r, r))), _mm_set1_ps(elbow));
+  __m128 nan = _mm_sub_ps(s, s);
+
+  __m128 theta2 = kinematics_atan2_sse(s, r);
+  __m128 theta1 = _mm_sub_ps(kinematics_atan2_sse(vy, vx),
+    kinematics_atan2_sse(_mm_mul_ps(l2, s), _mm_add_ps(l1, _mm_mul_ps(l2, r))));
+
+  _mm_storeu_ps(joint1, _mm_add_ps(kinematics_steps_sse(theta1), nan));
+  _mm_storeu_ps(joint2, _mm_add_ps(kinematics_steps_sse(theta2), nan));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 kinematics_atan2_avx2(__m256 y, __m256 x)
+{
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  __m256 ax = _mm256_andnot_ps(sign, x), ay = _mm256_andnot_ps(sign, y);
+  __m256 a = _mm256_div_ps(_mm256_min_ps(ax, ay), _mm256_max_ps(_mm256_max_ps(ax, ay), _mm256_set1_ps(FLT_MIN)));
+  __m256 a2 = _mm256_mul_ps(a, a);
+
+  __m256 p = _mm256_set1_ps(KINEMATICS_ATAN_C11);
+  p = _mm256_add_ps(_mm256_mul_ps(p, a2), _mm256_set1_ps(KINEMATICS_ATAN_C9));
+  p = _mm256_add_ps(_mm256_mul_ps(p, a2), _mm256_set1_ps(KINEMATICS_ATAN_C7));
+  p = _mm256_add_ps(_mm256_mul_ps(p, a2), _mm256_set1_ps(KINEMATICS_ATAN_C5));
+  p = _mm256_add_ps(_mm256_mul_ps(p, a2), _mm256_set1_ps(KINEMATICS_ATAN_C3));
+  p = _mm256_add_ps(_mm256_mul_ps(p, a2), _mm256_set1_ps(KINEMATICS_ATAN_C1));
+  p = _mm256_mul_ps(p, a);
+
+  __m256 swap = _mm256_cmp_ps(ay, ax, _CMP_GT_OQ);
+  p = _mm256_blendv_ps(p, _mm256_sub_ps(_mm256_set1_ps(M_PI_2), p), swap);
+  __m256 left = _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_LT_OQ);
+  p = _mm256_blendv_ps(p, _mm256_sub_ps(_mm256_set1_ps(M_PI), p), left);
+  return _mm256_xor_ps(p, _mm256_and_ps(y, sign));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 kinematics_steps_avx2(__m256 theta)
+{
+  __m256 v = _mm256_mul_ps(theta, _mm256_set1_ps(StepsPerRadian));
+  __m256 half = _mm256_or_ps(_mm256_and_ps(v, _mm256_set1_ps(-0.0f)), _mm256_set1_ps(0.5f));
+  return _mm256_cvtepi32_ps(_mm256_cvttps_epi32(_mm256_add_ps(v, half)));
+}
+
+// Converts the points in whole vectors of 8, returning how many
+__attribute__((target("avx2")))
+static size_t kinematics_inverse_avx2(const tsRational* x, const tsRational* y, size_t n, float elbow,
+  tsRational* joint1, tsRational* joint2)
+{
+  const __m256 l1 = _mm256_set1_ps(ShoulderPanLinkLength), l2 = _mm256_set1_ps(ElbowPanLinkLength);
+  size_t i;
+
+  for (i = 0; i + 8 <= n; i += 8)
+  {
+    __m256 vx = _mm256_loadu_ps(x + i), vy = _mm256_loadu_ps(y + i);
+
+    __m256 r = _mm256_mul_ps(_mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy)),
+      _mm256_set1_ps(ShoulderPanLinkLength*ShoulderPanLinkLength + ElbowPanLinkLength*ElbowPanLinkLength)),
+      _mm256_set1_ps(1 / (2*ShoulderPanLinkLength*ElbowPanLinkLength)));
+    __m256 s = _mm256_mul_ps(_mm256_sqrt_ps(_mm256_sub_ps(_mm256_set1_ps(1), _mm256_mul_ps(r, r))), _mm256_set1_ps(elbow));
+    __m256 nan = _mm256_sub_ps(s, s);
+
+    __m256 theta2 = kinematics_atan2_avx2(s, r);
+    __m256 theta1 = _mm256_sub_ps(kinematics_atan2_avx2(vy, vx),
+      kinematics_atan2_avx2(_mm256_mul_ps(l2, s), _mm256_add_ps(l1, _mm256_mul_ps(l2, r))));
+
+    _mm256_storeu_ps(joint1 + i, _mm256_add_ps(kinematics_steps_avx2(theta1), nan));
+    _mm256_storeu_ps(joint2 + i, _mm256_add_ps(kinematics_steps_avx2(theta2), nan));
+  }
+  return i;
+}
+
+#else
+
+static inline float kinematics_atan2_scalar(float y, float x)
+{
+  float ax = fabsf(x), ay = fabsf(y);
+  float a = fminf(ax, ay) / fmaxf(fmaxf(ax, ay), FLT_MIN);
+  float a2 = a * a;
+
+  float p = KINEMATICS_ATAN_C11;
+  p = p * a2 + KINEMATICS_ATAN_C9;
+  p = p * a2 + KINEMATICS_ATAN_C7;
+  p = p * a2 + KINEMATICS_ATAN_C5;
+  p = p * a2 + KINEMATICS_ATAN_C3;
+  p = p * a2 + KINEMATICS_ATAN_C1;
+  p = p * a;
+
+  if (ay > ax)
+    p = (float) M_PI_2 - p;
+  if (x < 0)
+    p = (float) M_PI - p;
+  return signbit(y) ? -p : p;
+}
+
+static inline float kinematics_steps_scalar(float theta)
+{
+  float v = theta * (float) StepsPerRadian;
+  return (float) (int) (v + copysignf(0.5f, v));
+}
+
+#endif
+
+void kinematics_inverse_many(const tsRational* x, const tsRational* y, size_t n, Elbow elbow,
+  tsRational* joint1, tsRational* joint2)
+{
+  const float sign = elbow == ELBOW_NEGATIVE ? -1 : 1;
+  size_t i = 0;
+
+#ifdef KINEMATICS_SIMD
+  if (__builtin_cpu_supports("avx2"))
+    i = kinematics_inverse_avx2(x, y, n, sign, joint1, joint2);
+  for (; i + KINEMATICS_LANES <= n; i += KINEMATICS_LANES)
+    kinematics_inverse_sse(x + i, y + i, sign, joint1 + i, joint2 + i);
+
+  // The last points go through a padded vector, so they round like the rest
+  if (i < n)
+  {
+    tsRational px[KINEMATICS_LANES], py[KINEMATICS_LANES], p1[KINEMATICS_LANES], p2[KINEMATICS_LANES];
+    size_t k, rest = n - i;
+    for (k = 0; k < KINEMATICS_LANES; k++)
+    {
+      px[k] = x[i + (k < rest ? k : 0)];
+      py[k] = y[i + (k < rest ? k : 0)];
+    }
+    kinematics_inverse_sse(px, py, sign, p1, p2);
+    for (k = 0; k < rest; k++)
+    {
+      joint1[i + k] = p1[k];
+      joint2[i + k] = p2[k];
+    }
+  }
+#else
+  const float l1 = ShoulderPanLinkLength, l2 = ElbowPanLinkLength;
+  for (; i < n; i++)
+  {
+    float r = (x[i] * x[i] + y[i] * y[i] - (float) (ShoulderPanLinkLength*ShoulderPanLinkLength + ElbowPanLinkLength*ElbowPanLinkLength))
+      * (float) (1 / (2*ShoulderPanLinkLength*ElbowPanLinkLength));
+    float s = sqrtf(1 - r * r) * sign;
+    float nan = s - s;
+    float theta2 = kinematics_atan2_scalar(s, r);
+    float theta1 = kinematics_atan2_scalar(y[i], x[i]) - kinematics_atan2_scalar(l2 * s, l1 + l2 * r);
+    joint1[i] = kinematics_steps_scalar(theta1) + nan;
+    joint2[i] = kinematics_steps_scalar(theta2) + nan;
+  }
+#endif
+}
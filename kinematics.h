@@ -0,0 +1,159 @@
+#ifndef KINEMATICS_H
+#define KINEMATICS_H
+
+#include <stddef.h>
+
+#include "fixed.h"
+#include "tinyspline.h"
+
+#define ShoulderPanLinkLength 8.75
+#define ElbowPanLinkLength 8.75
+#define StepsPerRadian 437.04
+
+typedef enum
+{
+  ELBOW_POSITIVE = 0, /* theta2 in [0, pi], the only solution used before */
+  ELBOW_NEGATIVE = 1  /* the mirrored solution with theta2 in [-pi, 0] */
+} Elbow;
+
+#define KINEMATICS_ELBOWS 2
+
+/**
+ * The joint ranges in encoder steps and the joint travel a change of the
+ * elbow configuration has to save before it is made.
+ */
+typedef struct
+{
+  double min[2];    /* theta1 and theta2 */
+  double max[2];
+  double hysteresis;
+} KinematicsLimits;
+
+/**
+ * Joint angles precomputed on a square grid over the workspace. Cells where
+ * bilinear interpolation strays too far from the exact angles, around the
+ * singularities at the edge of the reach and where atan2 wraps, are marked
+ * to be solved exactly instead.
+ */
+typedef struct
+{
+  float x0, y0;          /* pen position of the first node in inches */
+  float spacing;         /* inches between nodes */
+  size_t columns, rows;  /* nodes along x and y */
+  float* nodes[KINEMATICS_ELBOWS];      /* theta1, theta2 of every node in steps, row by row */
+  unsigned char* exact[KINEMATICS_ELBOWS]; /* per cell, 1 to solve exactly */
+  size_t n_exact[KINEMATICS_ELBOWS];    /* cells marked */
+} KinematicsGrid;
+
+/**
+ * How a stroke would be drawn in either elbow configuration.
+ */
+typedef struct
+{
+  double travel[KINEMATICS_ELBOWS];  /* |dtheta1| + |dtheta2| along the samples in steps */
+  size_t outside[KINEMATICS_ELBOWS]; /* samples beyond the joint limits */
+  double entry[KINEMATICS_ELBOWS][KINEMATICS_ELBOWS]; /* travel onto the first sample, by configuration before and after */
+  int entry_outside[KINEMATICS_ELBOWS]; /* the previous pen position is beyond the joint limits, by configuration */
+  tsRational first[2];               /* pen position of the first sample */
+} KinematicsStroke;
+
+/**
+ * Inverse kinematics of the pen position \x, \y in the \elbow configuration,
+ * the joint angles rounded to encoder steps.
+ */
+void kinematics_inverse(tsRational x, tsRational y, Elbow elbow, tsRational* theta1, tsRational* theta2);
+
+/**
+ * The pen position \x, \y in inches with the joints at \theta1, \theta2
+ * encoder steps, for an arm with links \link1 and \link2 inches long.
+ */
+void kinematics_forward(double theta1, double theta2, double link1, double link2, double* x, double* y);
+
+/**
+ * ::kinematics_inverse of the pen position \x, \y in inches in fixed point,
+ * with CORDIC for atan2 and no floating point. The joint angles in steps are
+ * the same as the float ones, or one step off where those lie close to the
+ * middle between two steps. Positions beyond the reach of the arm, where
+ * ::kinematics_inverse gives NaN, are solved for the arm stretched towards
+ * them, or folded for those too close to the shoulder.
+ */
+void kinematics_inverse_fixed(Fixed x, Fixed y, Elbow elbow, int* theta1, int* theta2);
+
+/**
+ * ::kinematics_inverse of the \n points at \x, \y at once, in single
+ * precision with a polynomial atan2, within 1e-4 rad of the exact angles.
+ * Rounded to encoder steps, a joint is at most one step off where the exact
+ * angle lies close to the middle between two steps. Runs 8 points at a time
+ * with AVX2 where the processor has it, otherwise 4 with SSE2, and one at a
+ * time on other architectures. AVX2 and SSE2 give the same steps, whatever
+ * the length of the array.
+ */
+void kinematics_inverse_many(const tsRational* x, const tsRational* y, size_t n, Elbow elbow,
+  tsRational* theta1, tsRational* theta2);
+
+/**
+ * ::kinematics_inverse of the \n consecutive points at \x, \y, each solved
+ * from the joint angles of the one before by a Newton step through the
+ * inverse of the arm's Jacobian, two where the points are far apart. The
+ * sines and cosines of the joints are turned along with them, so no
+ * trigonometry is left between points solved from scratch: the first, every
+ * \interval-th (0 for only where needed), any after a jump or where atan2
+ * wraps, and where the arm is close to stretched or folded. Rounded to
+ * encoder steps, a joint is at most one step off.
+ */
+void kinematics_inverse_incremental(const tsRational* x, const tsRational* y, size_t n, Elbow elbow, size_t interval,
+  tsRational* theta1, tsRational* theta2);
+
+/**
+ * Sets up \grid over the rectangle from \x0, \y0 to \x1, \y1 with nodes
+ * \spacing inches apart in both configurations. Every cell is checked at
+ * its centre and the middle of its edges, where the interpolation error of
+ * a smooth function peaks, and marked to be solved exactly if an angle is
+ * more than \tolerance steps off there.
+ *
+ * @return 0    on success.
+ * @return -1   if allocating the grid failed (errno is set).
+ */
+int kinematics_grid_new(KinematicsGrid* grid, double x0, double y0, double x1, double y1, double spacing,
+  double tolerance);
+
+/**
+ * Frees the nodes and marks of \grid.
+ */
+void kinematics_grid_free(KinematicsGrid* grid);
+
+/**
+ * ::kinematics_inverse of the \n points at \x, \y, interpolated bilinearly
+ * in \grid and rounded to steps. Points outside the grid or in a marked
+ * cell are solved exactly.
+ */
+void kinematics_grid_inverse(const KinematicsGrid* grid, const tsRational* x, const tsRational* y, size_t n,
+  Elbow elbow, tsRational* theta1, tsRational* theta2);
+
+/**
+ * Sets the travel and the samples beyond \limits of the \n samples at \x,
+ * \y in both configurations in \stroke, and the travel onto the first sample
+ * from the pen position \prev_x, \prev_y (-1 for none, which costs nothing).
+ */
+void kinematics_evaluate(const tsRational* x, const tsRational* y, size_t n, float prev_x, float prev_y,
+  const KinematicsLimits* limits, KinematicsStroke* stroke);
+
+/**
+ * Sets only the travel onto the first sample of \stroke from the pen
+ * position \prev_x, \prev_y (-1 for none), and whether the pen-up frames
+ * there are beyond \limits in either configuration.
+ */
+void kinematics_entry(KinematicsStroke* stroke, float prev_x, float prev_y, const KinematicsLimits* limits);
+
+/**
+ * Chooses the elbow configuration of \stroke when the arm is in \previous
+ * (-1 for none). The configuration only changes while the pen is \lifted,
+ * never on the paper, and only to one within the joint limits that saves
+ * more than \limits->hysteresis of joint travel onto and along the stroke.
+ * The pen-up frames the elbow turns over in count as within the limits only
+ * if they are. With no configuration within the limits the arm stays as it
+ * is.
+ */
+Elbow kinematics_choose(const KinematicsStroke* stroke, int previous, int lifted, const KinematicsLimits* limits);
+
+#endif // KINEMATICS_H
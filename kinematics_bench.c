@@ -0,0 +1,71 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h> // Error Checking
+#include <string.h> // Required for strerror
+#include <math.h>
+#include <time.h>
+
+#include "tinyspline.h"
+#include "kinematics.h"
+
+// Times kinematics_inverse one point at a time against kinematics_inverse_many
+// on the samples of a spiral over the reach of the arm, the best of a few
+// rounds each, in nanoseconds per point.
+
+#define BenchPoints 1000000 /* samples of the spiral */
+#define BenchRounds 5       /* the fastest one counts */
+
+static double now(void)
+{
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+int main(void)
+{
+  tsRational* x = malloc(BenchPoints * sizeof(tsRational));
+  tsRational* y = malloc(BenchPoints * sizeof(tsRational));
+  tsRational* theta1 = malloc(BenchPoints * sizeof(tsRational));
+  tsRational* theta2 = malloc(BenchPoints * sizeof(tsRational));
+  if (x == NULL || y == NULL || theta1 == NULL || theta2 == NULL)
+  {
+    fprintf(stderr,"Error: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  // From 2 inches off the shoulder out to just inside the reach
+  const double reach = ShoulderPanLinkLength + ElbowPanLinkLength;
+  for (size_t i = 0; i < BenchPoints; i++)
+  {
+    double t = (double) i / BenchPoints;
+    double r = 2 + t * (reach - 2.1), angle = t * 200 * M_PI;
+    x[i] = r * cos(angle);
+    y[i] = r * sin(angle);
+  }
+
+  double scalar = INFINITY, many = INFINITY, start, sum = 0;
+  for (int round = 0; round < BenchRounds; round++)
+  {
+    start = now();
+    for (size_t i = 0; i < BenchPoints; i++)
+      kinematics_inverse(x[i], y[i], ELBOW_POSITIVE, &theta1[i], &theta2[i]);
+    scalar = fmin(scalar, now() - start);
+    sum += theta1[round] + theta2[round];
+
+    start = now();
+    kinematics_inverse_many(x, y, BenchPoints, ELBOW_POSITIVE, theta1, theta2);
+    many = fmin(many, now() - start);
+    sum += theta1[round] + theta2[round];
+  }
+
+  fprintf(stdout,"kinematics_inverse:      %6.2f ns/pt\n", scalar * 1e9 / BenchPoints);
+  fprintf(stdout,"kinematics_inverse_many: %6.2f ns/pt, %.1fx\n", many * 1e9 / BenchPoints, scalar / many);
+  fprintf(stdout,"(checksum %g)\n", sum);
+
+  free(x);
+  free(y);
+  free(theta1);
+  free(theta2);
+  return EXIT_SUCCESS;
+}
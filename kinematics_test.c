@@ -0,0 +1,100 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h> // Error Checking
+#include <string.h> // Required for strerror
+#include <math.h>
+
+#include "tinyspline.h"
+#include "kinematics.h"
+
+// Checks kinematics_inverse_many against the scalar formula of
+// kinematics_inverse on a dense grid over the reach of the arm, in both elbow
+// configurations, and for every tail length the vector kernels pad. A joint
+// may be one step off, where the exact angle lies close to the middle between
+// two steps, and unreachable points must give NaN in both. The shoulder
+// itself, where any theta1 reaches it with the arm folded, is left out.
+
+#define TestSpacing 0.05 /* inches between grid points */
+#define TestTails 16     /* array lengths checked from 1 up */
+
+static size_t failures;
+
+static void check(const tsRational* x, const tsRational* y, size_t n, Elbow elbow, size_t* off)
+{
+  tsRational* many1 = malloc(n * sizeof(tsRational));
+  tsRational* many2 = malloc(n * sizeof(tsRational));
+  if (many1 == NULL || many2 == NULL)
+  {
+    fprintf(stderr,"Error: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  kinematics_inverse_many(x, y, n, elbow, many1, many2);
+  for (size_t i = 0; i < n; i++)
+  {
+    tsRational theta1, theta2;
+    if (x[i] == 0 && y[i] == 0)
+      continue;
+    kinematics_inverse(x[i], y[i], elbow, &theta1, &theta2);
+
+    // Either both solutions are NaN or neither, and then within one step
+    if (isnan(theta1) != isnan(many1[i]) || isnan(theta2) != isnan(many2[i])
+      || fabs(theta1 - many1[i]) > 1 || fabs(theta2 - many2[i]) > 1)
+    {
+      if (failures++ < 10)
+        fprintf(stderr,"Error: elbow %d at (%.4f, %.4f): %g %g, scalar %g %g\n", elbow, x[i], y[i],
+          many1[i], many2[i], theta1, theta2);
+    }
+    else if (!isnan(theta1) && (theta1 != many1[i] || theta2 != many2[i]))
+      (*off)++;
+  }
+
+  free(many1);
+  free(many2);
+}
+
+int main(void)
+{
+  // The whole square around the shoulder, a little beyond the reach
+  const double reach = ShoulderPanLinkLength + ElbowPanLinkLength + 0.5;
+  const size_t side = (size_t) (2 * reach / TestSpacing) + 1;
+  const size_t n = side * side;
+
+  tsRational* x = malloc(n * sizeof(tsRational));
+  tsRational* y = malloc(n * sizeof(tsRational));
+  if (x == NULL || y == NULL)
+  {
+    fprintf(stderr,"Error: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  for (size_t i = 0; i < n; i++)
+  {
+    x[i] = -reach + (i % side) * TestSpacing;
+    y[i] = -reach + (i / side) * TestSpacing;
+  }
+
+  size_t off[KINEMATICS_ELBOWS] = {0, 0};
+  for (int elbow = 0; elbow < KINEMATICS_ELBOWS; elbow++)
+  {
+    check(x, y, n, elbow, &off[elbow]);
+
+    // Short arrays go through the padded tail only, at odd offsets
+    for (size_t length = 1; length <= TestTails; length++)
+      for (size_t start = 0; start + length <= n; start += n / 97)
+        check(x + start, y + start, length, elbow, &off[elbow]);
+  }
+
+  fprintf(stdout,"%zu points, one step off: %zu positive elbow, %zu negative elbow\n", n,
+    off[ELBOW_POSITIVE], off[ELBOW_NEGATIVE]);
+
+  free(x);
+  free(y);
+
+  if (failures > 0)
+  {
+    fprintf(stderr,"Error: %zu points more than one step off\n", failures);
+    exit(EXIT_FAILURE);
+  }
+  fprintf(stdout,"kinematics_inverse_many agrees with kinematics_inverse\n");
+  return EXIT_SUCCESS;
+}
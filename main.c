@@ -5,21 +5,32 @@
 #include <string.h> // Required for strerror, <crc.h>
 #include <arpa/inet.h>
 #include <time.h> // srand
+#include <unistd.h> // getopt, sysconf
+#include <getopt.h> // getopt_long
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include "tinyspline.h"
 #include "crc.h"
+#include "curves.h"
+#include "sampling.h"
+#include "arclength.h"
+#include "arena.h"
+#include "trajectory.h"
+#include "packets.h"
+#include "ordering.h"
+#include "profile.h"
+#include "kinematics.h"
+#include "fixed.h"
+#include "calibration.h"
 
 #include "CPFrames.h"
 
-#define MaxTextExtent  4096 /* always >= 4096 */
-#define MaxCtrlPointsExtent 100 /* always >= 50 */
-
-#define ShoulderPanLinkLength 8.75
-#define ElbowPanLinkLength 8.75
 #define PPI 72
 
 #define ZDrawingPlane 380
 #define ZRetractPlane 20
+#define ZParkPlane 50 // height of the arm parked at the end of a job
 
 #define ZActuatorCalibrationBL 400
 #define ZActuatorCalibrationBR 280
@@ -29,372 +40,1909 @@
 #define WorkspaceLength 15.5
 #define WorkspaceWidth 9.5
 
-#define SPLINE_LENGTH_ERROR 1e-5
-#define SPLINE_LENGTH_MIN_DEPTH 5
+// Slopes of the drawing plane in actuator units per inch
+#define ZActuatorSlopeX (((ZActuatorCalibrationBR - ZActuatorCalibrationBL + ZActuatorCalibrationTR - ZActuatorCalibrationTL) * 0.5) / WorkspaceLength)
+#define ZActuatorSlopeY (((ZActuatorCalibrationTL - ZActuatorCalibrationBL + ZActuatorCalibrationTR - ZActuatorCalibrationBR) * 0.5) / WorkspaceWidth)
+
+// Joint limits of the velocity profile, theta in encoder steps, d3 in
+// actuator units
+#define Theta1Velocity 650.0 // steps/s, 1.5 rad/s
+#define Theta1Acceleration 2200.0 // steps/s^2, 5 rad/s^2
+#define Theta1Jerk 22000.0 // steps/s^3, 50 rad/s^3
+#define Theta2Velocity 870.0 // steps/s, 2 rad/s
+#define Theta2Acceleration 3000.0 // steps/s^2
+#define Theta2Jerk 30000.0 // steps/s^3
+#define D3Velocity 200.0
+#define D3Acceleration 1000.0
+#define D3Jerk 10000.0
+#define JunctionTime 0.01 // s the controller takes to turn the joints at a frame
+// Joint steps per inch of pen deviation at most, the Frobenius norm of the
+// arm's Jacobian bounds how far a joint-space deviation moves the pen
+#define BlendStepsPerInch (437.04 / sqrt(pow(ShoulderPanLinkLength + ElbowPanLinkLength, 2) + pow(ElbowPanLinkLength, 2)))
+
+// Wrist of the version 3 frames, the brush stays upright and rolls to face
+// the way the pen moves
+#define WristFlexAngle 0 // steps
+#define WristStepsPerRadian 437.04
+
+// Joint limits the elbow configuration is chosen within
+#define ShoulderPanLimit 2.967 // rad either way, 170 degrees
+#define ElbowPanLimit 2.618 // rad either way, 150 degrees
+#define ElbowHysteresis 100.0 // steps of joint travel a change of configuration has to save
+
+// The IK grid covers the workspace below the top edge of the page
+#define IKGridSpacing 0.1 // inches between nodes
+#define IKGridTolerance 0.25 // steps an interpolated angle may be off where checked
+#define IKAnchorInterval 32 // samples the incremental IK solves exactly at least once in
+
+#define AdaptiveTolerance 0.01 // Chord deviation in inches
+#define AdaptiveMaxSegment 0.5 // Segment length in inches
+
+#define PIPELINE_CHUNK 64 // Samples evaluated at once by the fused pipeline
+#define PACKET_BUFFER_FRAMES 4096 // Initial frames of a worker's buffer
+#define PLANNER_BATCH 1024 // Strokes handed to the worker pool at once
+
+#define SPLINE_LENGTH_ERROR 1e-5 // Quadrature error estimate per knot span piece
+
+typedef enum
+{
+  SAMPLER_DE_BOOR = 0,        /* de Boor evaluation at every parameter */
+  SAMPLER_FORWARD_DIFFERENCES /* forward differencing per Bezier piece */
+} Sampler;
+
+typedef enum
+{
+  SPACING_PARAMETER = 0, /* equal knot value steps of increment/length */
+  SPACING_DISTANCE,      /* equal distances along the stroke */
+  SPACING_ADAPTIVE       /* bounded chord deviation and segment length */
+} Spacing;
+
+typedef enum
+{
+  IK_EXACT = 0,  /* trigonometric inverse kinematics of every point */
+  IK_VECTORIZED, /* polynomial kernel over arrays of points, at most a step off */
+  IK_GRID,       /* bilinear interpolation in a grid over the workspace */
+  IK_INCREMENTAL /* Newton steps from the point before, solved exactly now and then */
+} InverseKinematics;
+
+typedef enum
+{
+  ELBOW_FIXED = 0, /* always the positive elbow */
+  ELBOW_CHOOSE,    /* the configuration with the least joint travel per stroke */
+  ELBOW_REPORT     /* the positive elbow, reporting what choosing would save */
+} ElbowMode;
+
+typedef struct
+{
+  size_t samples;      /* number of compared samples */
+  double max_error;    /* largest distance to the de Boor point in inches */
+  double sum_squared;  /* sum of the squared distances in square inches */
+  double max_spacing;  /* largest distance between consecutive samples in inches */
+  double max_chord;    /* largest distance of the curve from a chord in inches */
+} SamplerAccuracy;
+
+typedef struct
+{
+  PacketWriter *writer;      /* takes the frames when full, NULL to grow in memory */
+  size_t frame_size;         /* bytes per frame, CPV02_SIZE or CPV03_SIZE */
+  size_t used;               /* frames waiting in frames */
+  size_t capacity;           /* frames that fit into frames */
+  unsigned char *frames;
+} PacketBuffer;
+
+// Where the samples of a stroke planned without its predecessor ended up.
+// Planning it after the previous stroke may add the two pen-up transition
+// frames, which take the place of its last samples, so both variants are
+// kept until the previous pen position is known.
+typedef struct
+{
+  size_t first;             /* offset of the first sample frame in the worker's frames */
+  size_t n_frames;          /* sample frames without a transition */
+  size_t n_capped;          /* sample frames that fit after a transition */
+  float start_x, start_y;   /* pen position of the first sample */
+  float heading;            /* direction the pen moves in at the first sample, version 3 frames only */
+  float last_x, last_y;     /* pen position of the last emitted frame */
+  float capped_x, capped_y; /* pen position of sample n_capped-1 */
+  int replan;               /* the capped samples are not a prefix, plan again in order */
+  size_t worker;            /* worker whose frames hold the samples */
+  double duration;          /* predicted seconds of the profiled moves */
+  size_t n_paced;           /* sample frames left to the controller's speed */
+  size_t n_blended;         /* sample frames passed through on a blend */
+  Elbow elbow;              /* configuration chosen for the stroke */
+  KinematicsStroke kinematics; /* the stroke in both configurations, unless the elbow is fixed */
+} StrokePlan;
+
+typedef struct
+{
+  Sampler sampler;
+  Spacing spacing;
+  double tolerance;   /* largest chord deviation of adaptive spacing in inches */
+  double max_segment; /* longest segment of adaptive spacing in inches */
+  SamplerAccuracy *accuracy; /* compare samples against de Boor if not NULL */
+  int reorder;        /* draw the strokes in the order with the least pen-up travel */
+  double chain_tolerance; /* chain strokes whose ends are closer in inches, 0 for none */
+  double simplify;    /* drop frames within this many encoder steps of a joint-space line, negative for none */
+  const ProfileLimits *profile; /* hint the duration of every move if not NULL */
+  ElbowMode elbow;
+  const KinematicsLimits *kinematics; /* limits of choosing the elbow */
+  InverseKinematics ik;
+  const KinematicsGrid *grid; /* grid of IK_GRID */
+  int version;        /* CPV02_VERSION or CPV03_VERSION of the frames written */
+  const Calibration *calibration; /* fitted heights, NULL for the plane of the constants */
+} PlannerOptions;
+
+// The strokes of a job loaded up front, in the order they are drawn
+typedef struct
+{
+  size_t n_strokes;
+  size_t capacity;
+  size_t next;          /* first stroke not handed out yet */
+  tsBSpline *splines;
+  int *borrowed;        /* the spline borrows the mapping of the curves file */
+  unsigned char *joined; /* the stroke continues the previous one */
+} StrokeList;
+
+// What the job's strokes add up to, the elbow columns hold the positive
+// elbow and the chosen configurations
+typedef struct
+{
+  double time;          /* predicted seconds of the profiled moves */
+  size_t paced;         /* sample frames left to the controller's speed */
+  size_t blended;       /* sample frames passed through on a blend */
+  size_t strokes;
+  size_t changes;       /* strokes drawn in another configuration than the one before */
+  double travel[2];     /* joint travel onto and along the strokes in steps */
+  size_t outside[2];    /* samples beyond the joint limits */
+} JobReport;
 
 tsRational linear_length(tsRational start_x, tsRational start_y, tsRational end_x, tsRational end_y)
 {
   return sqrt(pow((start_x - end_x),2) + pow((start_y - end_y),2));
 }
 
-tsRational spline_length(tsBSpline *spline, tsRational start, tsRational end, tsRational start_x, tsRational start_y, tsRational end_x, tsRational end_y, size_t depth)
+float actuator_delta(float x, float y) {
+  // The two deltas for each direction SHOULD be the same, but we average them in practice.
+  float slope_x = ZActuatorSlopeX;
+  float slope_y = ZActuatorSlopeY;
+
+  // We assume an origin at the bottom left.
+  return x * slope_x + y * slope_y + slope_x*(WorkspaceWidth/2.0);
+}
+
+#ifdef SMC_FIXED_POINT
+// actuator_delta with the slopes folded into constants
+static inline Fixed actuator_delta_fixed(Fixed x, Fixed y)
 {
-  tsRational mid = (start + end) / 2.f;
+  return (((int64_t) x * FIXED_CONSTANT(ZActuatorSlopeX) + (int64_t) y * FIXED_CONSTANT(ZActuatorSlopeY)) >> FIXED_SHIFT)
+    + FIXED_CONSTANT(ZActuatorSlopeX * (WorkspaceWidth / 2.0));
+}
+#endif
 
-  tsDeBoorNet mid_point;
-  ts_bspline_evaluate(spline, mid, &mid_point);
+// Compares sampled points against de Boor evaluation at the same parameters,
+// us[j] or j*increment if us is NULL
+void sampler_accuracy_update(SamplerAccuracy *accuracy, tsBSpline *spline, tsRational *scratch, float increment, const tsRational *us, tsRational *points, size_t n_samples)
+{
+  size_t j;
+  for (j = 0; j < n_samples; j++)
+  {
+    tsRational expected[2];
+    ts_bspline_evaluate_point(spline, us != NULL ? us[j] : j * increment, scratch, expected);
 
-  tsRational mid_x = mid_point.result[0];
-  tsRational mid_y = mid_point.result[1];
-  ts_deboornet_free(&mid_point); // Cleanup
+    if (j > 0)
+    {
+      double spacing = linear_length(points[j*2], points[j*2+1], points[j*2-2], points[j*2-1]) / PPI;
+      if (spacing > accuracy->max_spacing)
+        accuracy->max_spacing = spacing;
+
+      // Distance of the curve half way between the samples from their chord
+      tsRational middle[2];
+      tsRational previous = us != NULL ? us[j-1] : (j-1) * increment;
+      ts_bspline_evaluate_point(spline, (previous + (us != NULL ? us[j] : j * increment)) / 2, scratch, middle);
+      double dx = points[j*2] - points[j*2-2], dy = points[j*2+1] - points[j*2-1];
+      double chord = dx*dx + dy*dy;
+      double t = chord > 0 ? ((middle[0] - points[j*2-2]) * dx + (middle[1] - points[j*2-1]) * dy) / chord : 0;
+      t = t < 0 ? 0 : (t > 1 ? 1 : t);
+      double deviation = linear_length(middle[0], middle[1], points[j*2-2] + t*dx, points[j*2-1] + t*dy) / PPI;
+      if (deviation > accuracy->max_chord)
+        accuracy->max_chord = deviation;
+    }
 
-  tsRational length = linear_length(end_x, end_y, start_x, start_y);
-  tsRational first_half = linear_length(mid_x, mid_y, start_x, start_y);
-  tsRational second_half = linear_length(end_x, end_y, mid_x, mid_y);
+    double error = linear_length(points[j*2], points[j*2+1], expected[0], expected[1]) / PPI;
+    if (error > accuracy->max_error)
+      accuracy->max_error = error;
+    accuracy->sum_squared += error * error;
+    accuracy->samples++;
+  }
+}
 
-  tsRational length2 = first_half + second_half;
-  if ((length2 - length > SPLINE_LENGTH_ERROR) || (depth < SPLINE_LENGTH_MIN_DEPTH))
+// Allocates from the stroke arena, running out of memory ends the job
+void *planner_alloc(Arena *arena, size_t size)
+{
+  void *memory = arena_alloc(arena, size);
+  if (memory == NULL)
   {
-    depth++;
-    return spline_length(spline, start, mid, start_x, start_y, mid_x, mid_y, depth) + spline_length(spline, mid, end, mid_x, mid_y, end_x, end_y, depth);
+    fprintf(stderr,"Error: Out of Memory: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
   }
-
-  return length2;
+  return memory;
 }
 
-// Returns the value to be added to the computed actuator value to account for the arm plane not being parallel to the paper plane
-float actuator_delta(float x, float y) {
-  // The two deltas for each direction SHOULD be the same, but we average them in practice.
-  float slope_x = ((ZActuatorCalibrationBR - ZActuatorCalibrationBL + ZActuatorCalibrationTR - ZActuatorCalibrationTL) * 0.5) / WorkspaceLength;
-  float slope_y = ((ZActuatorCalibrationTL - ZActuatorCalibrationBL + ZActuatorCalibrationTR - ZActuatorCalibrationBR) * 0.5) / WorkspaceWidth;
+// Directions the pen moves in on the page at the n parameters us, from the
+// derivative of spline evaluated at the same parameters as the samples. Where
+// the derivative vanishes the direction before is kept.
+void spline_to_headings(tsBSpline *spline, const tsRational *us, size_t n, Arena *arena, tsRational *headings)
+{
+  tsBSpline derivative;
+  tsError err = ts_bspline_derive(spline, &derivative);
+  if (err < 0)
+  {
+    fprintf(stderr,"Error: Spline Derivative: %s\n", ts_enum_str(err));
+    exit(EXIT_FAILURE);
+  }
+  tsRational *scratch = planner_alloc(arena, sizeof(tsRational) * spline->order * spline->dim);
+  tsRational *tangents = planner_alloc(arena, sizeof(tsRational) * spline->dim * n);
+  err = ts_bspline_evaluate_many(&derivative, us, n, scratch, tangents);
+  ts_bspline_free(&derivative);
+  if (err < 0)
+  {
+    fprintf(stderr,"Error: Spline Evaluation: %s\n", ts_enum_str(err));
+    exit(EXIT_FAILURE);
+  }
 
-  // We assume an origin at the bottom left.
-  return x * slope_x + y * slope_y + slope_x*(WorkspaceWidth/2.0);
+  size_t j;
+  tsRational heading = 0;
+  for (j = 0; j < n; j++)
+  {
+    tsRational *tangent = tangents + j * spline->dim;
+    // The page's y axis points the other way than the drawing's
+    if (tangent[0] != 0 || tangent[1] != 0)
+      heading = atan2(-tangent[1], tangent[0]);
+    headings[j] = heading;
+  }
 }
 
-tsRational** spline_to_cartesian(tsBSpline *spline, float increment, size_t *size, float prev_x, float prev_y)
+void spline_to_cartesian(tsBSpline *spline, float increment, float prev_x, float prev_y, const PlannerOptions *options, Arena *arena, Trajectory *trajectory, StrokePlan *plan)
 {
   tsRational u;
-  tsDeBoorNet net;
+  size_t size;
 
-  // Calculate Length
-  tsDeBoorNet start, end;
-  ts_bspline_evaluate(spline, 0, &start);
-  ts_bspline_evaluate(spline, 1, &end);
+  // De Boor scratch space, shared by every evaluation of this spline
+  tsRational *scratch = planner_alloc(arena, sizeof(tsRational) * spline->order * spline->dim);
 
-  tsRational length = spline_length(spline, 0, 1, start.result[0], start.result[1], end.result[0], end.result[1], 0);
-  length = length/PPI; // Convert to Inches
-  increment = increment/length;
-
-  // Clean up Calculate Length
-  ts_deboornet_free(&start);
-  ts_deboornet_free(&end);
+  // Calculate Length
+  tsRational start[2], end[2];
+  ts_bspline_evaluate_point(spline, 0, scratch, start);
+  ts_bspline_evaluate_point(spline, 1, scratch, end);
+
+  double arc_length;
+  ArcLengthTable table;
+  tsRational *us = NULL;
+  size_t n_samples = 0, capacity = 0, j;
+  tsError err;
+  if (options->spacing == SPACING_ADAPTIVE)
+  {
+    // The knots follow from the shape of the stroke, no length needed
+    err = sampling_adaptive(spline, options->tolerance * PPI, options->max_segment * PPI, &us, &n_samples, &capacity);
+    if (err < 0)
+    {
+      fprintf(stderr,"Error: Adaptive Sampling: %s\n", ts_enum_str(err));
+      exit(EXIT_FAILURE);
+    }
+    size = n_samples;
+  }
+  else
+  {
+    if (options->spacing == SPACING_DISTANCE)
+    {
+      err = arclength_table_new(spline, SPLINE_LENGTH_ERROR, &table);
+      arc_length = table.length;
+    }
+    else
+    {
+      err = arclength_length(spline, SPLINE_LENGTH_ERROR, &arc_length);
+    }
+    if (err < 0)
+    {
+      fprintf(stderr,"Error: Spline Length: %s\n", ts_enum_str(err));
+      exit(EXIT_FAILURE);
+    }
+    tsRational length = arc_length/PPI; // Convert to Inches
+    increment = increment/length;
 
-  *size = 1.f/increment + 1;
+    size = 1.f/increment + 1;
+  }
 
   float distance;
   float curr_x, curr_y;
 
   {
-    tsDeBoorNet net;
-    ts_bspline_evaluate(spline, 0.f, &net);
-    curr_x = net.result[0]/PPI - 8.5; // x
-    curr_y = 15 - net.result[1]/PPI; // y
-    ts_deboornet_free(&net);
+    curr_x = start[0]/PPI - 8.5; // x
+    curr_y = 15 - start[1]/PPI; // y
 
     distance = sqrt(pow(curr_x - prev_x, 2)+pow(curr_y - prev_y, 2));
-    *size = *size + 2;
+    size = size + 2;
   }
 
-  tsRational **cartesian = malloc(sizeof(tsRational *)* (*size));
+  if (trajectory_new(arena, size, trajectory) == -1)
+  {
+    fprintf(stderr,"Error: Out of Memory: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  tsRational *x = trajectory->x, *y = trajectory->y, *z = trajectory->z;
 
   size_t i = 0;
 
   if (prev_x != -1 && distance > 0.1f){
     // Move to Pen up at Last X Y
-    {
-      tsRational *result = malloc(sizeof(tsRational) * 3);
-      result[0] = prev_x; // x
-      result[1] = prev_y; // y
-      result[2] = 0; // z
-      cartesian[i] = result;
-      // printf("E%zd (L0), %f, %f, %f\n", i, cartesian[i][0], cartesian[i][1], cartesian[i][2]);
-      i++;
-    }
+    x[i] = prev_x;
+    y[i] = prev_y;
+    z[i] = 0;
+    // printf("E%zd (L0), %f, %f, %f\n", i, x[i], y[i], z[i]);
+    i++;
 
     // Move to New X Y
+    x[i] = prev_x;
+    y[i] = prev_y;
+    z[i] = 0;
+    // printf("S%zd (0), %f, %f, %f\n", i, x[i], y[i], z[i]);
+    i++;
+  }
+
+  // Collect the parameters first, so the knot vector is walked only once
+  if (options->spacing != SPACING_ADAPTIVE)
+  {
+    us = planner_alloc(arena, sizeof(tsRational) * size);
+  }
+  if (options->spacing == SPACING_DISTANCE)
+  {
+    // Equal steps of increment inches along the stroke, mapped back to knots.
+    // A dot has no length to step along and is drawn at its start.
+    const double step = arc_length > 0 ? arc_length * increment : 0;
+    size_t cursor = 0;
+    double knot;
+    if (arc_length == 0)
     {
-      tsRational *result = malloc(sizeof(tsRational) * 3);
-      result[0] = prev_x; // x
-      result[1] = prev_y; // y
-      result[2] = 0; // z
-      cartesian[i] = result;
-      // printf("S%zd (0), %f, %f, %f\n", i, cartesian[i][0], cartesian[i][1], cartesian[i][2]);
-      i++;
+      us[n_samples++] = 0;
+    }
+    for (; arc_length > 0 && n_samples * step <= arc_length && i + n_samples < size; n_samples++)
+    {
+      err = arclength_table_invert(&table, n_samples * step, &cursor, &knot);
+      if (err < 0)
+      {
+        fprintf(stderr,"Error: Spline Length: %s\n", ts_enum_str(err));
+        exit(EXIT_FAILURE);
+      }
+      us[n_samples] = knot;
+    }
+    arclength_table_free(&table);
+  }
+  else if (options->spacing == SPACING_PARAMETER)
+  {
+    for (u = 0.f; u <= 1.f && i + n_samples < size; u += increment)
+    {
+      us[n_samples++] = u;
     }
   }
 
-  for (u = 0.f; u <= 1.f; u += increment)
+  tsRational *points = planner_alloc(arena, sizeof(tsRational) * spline->dim * n_samples);
+  if (options->sampler == SAMPLER_FORWARD_DIFFERENCES)
+  {
+    err = sampling_forward_differences(spline, increment, n_samples, points);
+  }
+  else
   {
-    ts_bspline_evaluate(spline, u, &net);
+    err = ts_bspline_evaluate_many(spline, us, n_samples, scratch, points);
+  }
+  if (err < 0)
+  {
+    fprintf(stderr,"Error: Spline Evaluation: %s\n", ts_enum_str(err));
+    exit(EXIT_FAILURE);
+  }
+
+  if (options->accuracy != NULL)
+  {
+    sampler_accuracy_update(options->accuracy, spline, scratch, increment,
+      options->spacing != SPACING_PARAMETER ? us : NULL, points, n_samples);
+  }
+
+  // The pen-up frames already face the way the stroke starts
+  plan->heading = 0;
+  if (options->version == CPV03_VERSION && n_samples > 0)
+  {
+    spline_to_headings(spline, us, n_samples, arena, trajectory->heading + i);
+    plan->heading = trajectory->heading[i];
+    for (j = 0; j < i; j++)
+      trajectory->heading[j] = plan->heading;
+  }
+
+  for (j = 0; j < n_samples; j++)
+  {
+    tsRational *point = points + j * spline->dim;
 
     // Store in Memmory
-    tsRational *result = malloc(sizeof(tsRational) * 3);
-    result[0] = net.result[0]/PPI - 8.5; // x
-    result[1] = 15 - net.result[1]/PPI; // y
-    result[2] = 0; // z
-    cartesian[i] = result;
-    // printf("%zd (%03.2f), %f, %f, %f\n", i, u, cartesian[i][0], cartesian[i][1], cartesian[i][2]);
+    x[i] = point[0]/PPI - 8.5;
+    y[i] = 15 - point[1]/PPI;
+    z[i] = 0;
+    // printf("%zd (%03.2f), %f, %f, %f\n", i, us[j], x[i], y[i], z[i]);
     i++;
+  }
+
+  trajectory->size = i;
+
+  // A transition would leave room for size-2 samples
+  plan->start_x = curr_x;
+  plan->start_y = curr_y;
+  plan->n_frames = n_samples;
+  plan->n_capped = n_samples < size - 2 ? n_samples : size - 2;
+  plan->last_x = x[i-1];
+  plan->last_y = y[i-1];
+  plan->capped_x = x[i - n_samples + plan->n_capped - 1];
+  plan->capped_y = y[i - n_samples + plan->n_capped - 1];
+  // Forward differencing may pick another evaluation for fewer samples
+  plan->replan = options->sampler == SAMPLER_FORWARD_DIFFERENCES && plan->n_capped < n_samples;
+  if (options->spacing == SPACING_ADAPTIVE)
+  {
+    free(us); // grown by sampling_adaptive
+  }
+}
+
+#ifdef SMC_FIXED_POINT
+// Height of the linear actuator on the drawing plane, rounded down like the
+// frames do
+static inline int cartesian_to_height_fixed(Fixed x, Fixed y)
+{
+  return (FIXED_CONSTANT(ZDrawingPlane) + actuator_delta_fixed(x, y)) >> FIXED_SHIFT;
+}
+#endif
+
+// Height of the linear actuator for the pen position
+static inline tsRational cartesian_to_height(tsRational x, tsRational y, tsRational z, const PlannerOptions *options)
+{
+  if (options->calibration != NULL){
+    return z == -1 ? options->calibration->retract : calibration_height(options->calibration, x, y);
+  }else if (z == -1){
+    return ZRetractPlane;
+  }else{
+#ifdef SMC_FIXED_POINT
+    return cartesian_to_height_fixed(fixed_from_float(x), fixed_from_float(y));
+#else
+    return ZDrawingPlane + actuator_delta(x, y);
+#endif
+  }
+}
 
-    ts_deboornet_free(&net);
+// Joint angles of n pen positions in encoder steps, solved as options ask
+static inline void cartesian_to_angles(const tsRational *x, const tsRational *y, size_t n, Elbow elbow, const PlannerOptions *options, tsRational *theta1, tsRational *theta2)
+{
+  size_t i;
+  switch (options->ik)
+  {
+    case IK_VECTORIZED:
+      kinematics_inverse_many(x, y, n, elbow, theta1, theta2);
+      break;
+    case IK_GRID:
+      kinematics_grid_inverse(options->grid, x, y, n, elbow, theta1, theta2);
+      break;
+    case IK_INCREMENTAL:
+      kinematics_inverse_incremental(x, y, n, elbow, IKAnchorInterval, theta1, theta2);
+      break;
+    default:
+      for (i = 0; i < n; i++)
+      {
+#ifdef SMC_FIXED_POINT
+        int steps1, steps2;
+        kinematics_inverse_fixed(fixed_from_float(x[i]), fixed_from_float(y[i]), elbow, &steps1, &steps2);
+        theta1[i] = steps1;
+        theta2[i] = steps2;
+#else
+        kinematics_inverse(x[i], y[i], elbow, &theta1[i], &theta2[i]);
+#endif
+      }
   }
+}
+
+// Inverse kinematics of one pen position, joint angles in encoder steps
+static inline void cartesian_to_joints(tsRational x, tsRational y, tsRational z, Elbow elbow, const PlannerOptions *options, tsRational *joint1, tsRational *joint2, tsRational *d3)
+{
+  cartesian_to_angles(&x, &y, 1, elbow, options, joint1, joint2);
+  *d3 = cartesian_to_height(x, y, z, options);
+}
+
+// Wrist roll in steps that turns the brush to heading with the arm at the
+// steps theta1 and theta2, within half a turn either way
+static inline tsRational heading_to_roll(tsRational heading, tsRational theta1, tsRational theta2)
+{
+  return round(remainder(heading - (floor(theta1) + floor(theta2)) / StepsPerRadian, 2 * M_PI) * WristStepsPerRadian);
+}
+
+// Quantizes joint values into a version 3 frame with the brush upright and
+// seals it with its CRC
+static inline CPFrameVersion03 joints_to_frame_v03(tsRational joint1, tsRational joint2, tsRational joint4, tsRational joint5)
+{
+  short theta1, theta2, theta4, d5;
+  theta1 = floor(joint1); theta2 = floor(joint2); theta4 = floor(joint4); d5 = floor(joint5);
+  CPFrameVersion03 frame = {StartFrameDelimiter, CPV03_VERSION, theta1, theta2, WristFlexAngle, theta4, d5, 0, EndOfFrame};
+  frame.CRC = crcFast((unsigned char *) &frame, CPV03_SIZE-3);
+  return frame;
+}
 
-  *size = i;
+// Packs joint steps into a frame and seals it with its CRC
+static inline CPFrameVersion02 steps_to_frame(short theta1, short theta2, short d3)
+{
+  CPFrameVersion02 frame = {StartFrameDelimiter, CPV02_VERSION, 0, theta1, theta2, d3, 0, EndOfFrame};
+  frame.CRC = crcFast((unsigned char *) &frame, CPV02_SIZE-3);
+  return frame;
+}
 
-  return cartesian;
+// Quantizes joint values into a frame
+static inline CPFrameVersion02 joints_to_frame(tsRational joint1, tsRational joint2, tsRational joint3)
+{
+  short theta1, theta2, d3;
+  theta1 = floor(joint1); theta2 = floor(joint2); d3 = floor(joint3);
+  return steps_to_frame(theta1, theta2, d3);
 }
 
-tsRational** cartesian_to_motor_angles(tsRational **cartesian, size_t size)
+// Sets the CODE of a finished frame, which the CRC covers
+static inline void frame_set_code(CPFrameVersion02 *frame, unsigned char code)
 {
+  frame->CODE = code;
+  frame->CRC = crcFast((unsigned char *) frame, CPV02_SIZE-3);
+}
 
-  tsRational **transformation = malloc(sizeof(tsRational *)* size);
+// The CODE asking for a move of duration seconds, in whole milliseconds so
+// the move is never faster than planned. Moves that fit no code are left to
+// the controller.
+static inline unsigned char duration_to_code(double duration)
+{
+  double ms = ceil(duration * 1000);
+  return ms > 0 && ms <= CPV02_CODE_DURATION ? ms : 0;
+}
 
+// The first n_transition pen-up frames are solved apart from the samples, as
+// the workers plan strokes without them and incremental IK must not carry
+// over from one to the other
+void cartesian_to_motor_angles(Trajectory *trajectory, size_t n_transition, Elbow elbow, const PlannerOptions *options)
+{
   size_t i;
-  for (i = 0; i < size; i++)
+  cartesian_to_angles(trajectory->x, trajectory->y, n_transition, elbow, options, trajectory->theta1, trajectory->theta2);
+  cartesian_to_angles(trajectory->x + n_transition, trajectory->y + n_transition, trajectory->size - n_transition, elbow, options,
+    trajectory->theta1 + n_transition, trajectory->theta2 + n_transition);
+  for (i = 0; i < trajectory->size; i++)
+  {
+    trajectory->d3[i] = cartesian_to_height(trajectory->x[i], trajectory->y[i], trajectory->z[i], options);
+    // printf("C%zd, %f, %f, %f\n", i, trajectory->theta1[i], trajectory->theta2[i], trajectory->d3[i]);
+  }
+  for (i = 0; i < trajectory->size; i++)
   {
-    tsRational *result = malloc(sizeof(tsRational) * 3);
-    float theta1, theta2, r;
+    trajectory->theta4[i] = options->version == CPV03_VERSION
+      ? heading_to_roll(trajectory->heading[i], trajectory->theta1[i], trajectory->theta2[i]) : 0;
+  }
+}
+
+CPFrameVersion02 *motor_angles_to_packet(const Trajectory *trajectory, Arena *arena)
+{
+  CPFrameVersion02 *packets = planner_alloc(arena, sizeof(CPFrameVersion02) * trajectory->size);
+  size_t i;
+  for (i = 0; i < trajectory->size; i++)
+  {
+    packets[i] = joints_to_frame(trajectory->theta1[i], trajectory->theta2[i], trajectory->d3[i]);
+  }
 
-    r = (pow(cartesian[i][0],2)+pow(cartesian[i][1],2)-pow(ShoulderPanLinkLength,2)-pow(ElbowPanLinkLength,2))/(2*ShoulderPanLinkLength*ElbowPanLinkLength);
-    theta2 = atan2(sqrt(1-pow(r,2)),r);
-    theta1 = atan2(cartesian[i][1], cartesian[i][0]) - atan2(ElbowPanLinkLength*sin(theta2), ShoulderPanLinkLength+ElbowPanLinkLength*cos(theta2));
+  return packets;
+}
 
-    result[0] = roundf(theta1*437.04);
-    result[1] = roundf(theta2*437.04);
-    if (cartesian[i][2] == -1){
-      result[2] = ZRetractPlane;
-    }else{
-      result[2] = ZDrawingPlane + actuator_delta(cartesian[i][0], cartesian[i][1]);
+void packet_buffer_init(PacketBuffer *buffer, PacketWriter *writer, size_t frame_size, size_t capacity)
+{
+  buffer->writer = writer;
+  buffer->frame_size = frame_size;
+  buffer->used = 0;
+  buffer->capacity = capacity;
+  if (writer != NULL)
+    buffer->frames = packets_commit(writer, 0, &buffer->capacity);
+  else
+    buffer->frames = malloc(frame_size * capacity);
+  if (buffer->frames == NULL)
+  {
+    fprintf(stderr,"Error: Out of Memory: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Makes room for more frames, by handing the block to the writer or growing
+// the buffer
+void packet_buffer_reserve(PacketBuffer *buffer)
+{
+  if (buffer->writer != NULL)
+  {
+    buffer->frames = packets_commit(buffer->writer, buffer->used, &buffer->capacity);
+    buffer->used = 0;
+    if (buffer->frames == NULL)
+    {
+      fprintf(stderr,"Error: File Write Operation: %s\n", strerror(errno));
+      exit(EXIT_FAILURE);
     }
-    transformation[i] = result;
-    // printf("C%zd, %f, %f, %f\n", i, transformation[i][0], transformation[i][1], transformation[i][2]);
+    return;
   }
 
-  return transformation;
+  unsigned char *frames = realloc(buffer->frames, buffer->frame_size * buffer->capacity * 2);
+  if (frames == NULL)
+  {
+    fprintf(stderr,"Error: Out of Memory: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  buffer->frames = frames;
+  buffer->capacity *= 2;
 }
 
-CPFrameVersion02 *motor_angles_to_packet(tsRational **transformation, size_t size)
+static inline void packet_buffer_append(PacketBuffer *buffer, CPFrameVersion02 frame)
 {
-  CPFrameVersion02 *packets = malloc(sizeof(CPFrameVersion02) * size);
-  size_t i;
-  for (i = 0; i < size; i++)
+  if (buffer->used == buffer->capacity)
   {
-    tsRational *result = transformation[i];
-    short theta1, theta2, d3;
-    theta1 = floor(result[0]); theta2 = floor(result[1]); d3 = floor(result[2]);
-    CPFrameVersion02 frame = {StartFrameDelimiter, CPV02_VERSION, 0, theta1, theta2, d3, 0, EndOfFrame};
-    frame.CRC = crcFast((unsigned char *) &frame, CPV02_SIZE-3);
-    packets[i] = frame;
+    packet_buffer_reserve(buffer);
   }
-
-  return packets;
+  ((CPFrameVersion02 *) buffer->frames)[buffer->used++] = frame;
 }
 
-tsRational** destroy_cartesian(tsRational **cartesian, size_t size)
+static inline void packet_buffer_append_v03(PacketBuffer *buffer, CPFrameVersion03 frame)
 {
-  size_t i;
-  for (i = 0; i < size; i++)
+  if (buffer->used == buffer->capacity)
   {
-    free((tsRational *) cartesian[i]);
+    packet_buffer_reserve(buffer);
   }
-  free(cartesian);
+  ((CPFrameVersion03 *) buffer->frames)[buffer->used++] = frame;
+}
 
-  return NULL;
+// Frame i of buffer
+static inline const unsigned char *packet_buffer_frame(const PacketBuffer *buffer, size_t i)
+{
+  return buffer->frames + i * buffer->frame_size;
 }
 
-int motion_planning_packets(const char *curves_file, const char *packets_buffer_file)
+void packet_buffer_append_many(PacketBuffer *buffer, const unsigned char *frames, size_t n)
 {
-  FILE* file = fopen(curves_file, "r");
-  if(file == NULL)
+  while (n > 0)
   {
-    fprintf(stderr,"File Null Error <%s>: %s\n", curves_file, strerror(errno));
-    exit(EXIT_FAILURE);
+    if (buffer->used == buffer->capacity)
+    {
+      packet_buffer_reserve(buffer);
+    }
+    size_t run = buffer->capacity - buffer->used < n ? buffer->capacity - buffer->used : n;
+    memcpy(buffer->frames + buffer->used * buffer->frame_size, frames, buffer->frame_size * run);
+    buffer->used += run;
+    frames += buffer->frame_size * run;
+    n -= run;
   }
+}
 
-  FILE *packets_buffer = fopen(packets_buffer_file, "wb+");
-  if(file == NULL)
+// Closes the writer of buffer after its last frames, or frees the frames
+void packet_buffer_free(PacketBuffer *buffer)
+{
+  if (buffer->writer != NULL)
   {
-    fprintf(stderr,"File Null Error <%s>: %s\n", packets_buffer_file, strerror(errno));
+    if (packets_close(buffer->writer, buffer->used) == -1)
+    {
+      fprintf(stderr,"Error: File Write Operation: %s\n", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+  }
+  else
+  {
+    free(buffer->frames);
+  }
+  buffer->frames = NULL;
+  buffer->used = buffer->capacity = 0;
+}
+
+// One frame through the whole pipeline: IK, quantization, CRC and emission,
+// version 3 frames roll the brush to heading
+static inline void cartesian_to_packet(PacketBuffer *buffer, tsRational x, tsRational y, tsRational z, tsRational heading, Elbow elbow, const PlannerOptions *options)
+{
+  tsRational joint1, joint2, d3;
+  cartesian_to_joints(x, y, z, elbow, options, &joint1, &joint2, &d3);
+  if (options->version == CPV03_VERSION)
+    packet_buffer_append_v03(buffer, joints_to_frame_v03(joint1, joint2, heading_to_roll(heading, joint1, joint2), d3));
+  else
+    packet_buffer_append(buffer, joints_to_frame(joint1, joint2, d3));
+}
+
+// Plans a stroke with equal knot steps sampled by de Boor without
+// materializing it. The samples are evaluated in chunks small enough to stay
+// in L1 and every chunk is turned into packets before the next is sampled,
+// so a stroke needs the same memory whatever its length. The frames are the
+// ones spline_to_cartesian, cartesian_to_motor_angles and
+// motor_angles_to_packet produce.
+void spline_to_packets(tsBSpline *spline, float increment, float prev_x, float prev_y, const PlannerOptions *options, Arena *arena, PacketBuffer *buffer, StrokePlan *plan)
+{
+#ifndef SMC_FIXED_POINT
+  tsRational u;
+  tsRational us[PIPELINE_CHUNK];
+  tsRational *points = planner_alloc(arena, sizeof(tsRational) * spline->dim * PIPELINE_CHUNK);
+#endif
+  tsRational xs[PIPELINE_CHUNK], ys[PIPELINE_CHUNK], theta1[PIPELINE_CHUNK], theta2[PIPELINE_CHUNK];
+  tsRational *scratch = planner_alloc(arena, sizeof(tsRational) * spline->order * spline->dim);
+
+  tsRational start[2];
+  ts_bspline_evaluate_point(spline, 0, scratch, start);
+
+  double arc_length;
+  tsError err = arclength_length(spline, SPLINE_LENGTH_ERROR, &arc_length);
+  if (err < 0)
+  {
+    fprintf(stderr,"Error: Spline Length: %s\n", ts_enum_str(err));
     exit(EXIT_FAILURE);
   }
+  tsRational length = arc_length/PPI; // Convert to Inches
+  increment = increment/length;
 
-  crcInit();
-  srand(time(NULL));   // should only be called once
-  char buffer[MaxTextExtent];
+  // Same frame budget as spline_to_cartesian
+  size_t size = 1.f/increment + 1;
+  size = size + 2;
 
-  int found_tool = 0;
-  int tool_number = 0;
-  tsRational *points;
-  size_t count = -1;
-  char *ret = NULL;
-  size_t full_length = 0;
+  float curr_x = start[0]/PPI - 8.5; // x
+  float curr_y = 15 - start[1]/PPI; // y
+  float distance = sqrt(pow(curr_x - prev_x, 2)+pow(curr_y - prev_y, 2));
 
-  float prev_x, prev_y;
-  prev_x = -1;
-  prev_y = -1;
+  size_t i = 0, n, j, n_samples = 0;
+
+  plan->start_x = curr_x;
+  plan->start_y = curr_y;
+  plan->replan = 0;
+
+  if (prev_x != -1 && distance > 0.1f){
+    // Move to Pen up at Last X Y, then to New X Y
+    cartesian_to_packet(buffer, prev_x, prev_y, 0, 0, ELBOW_POSITIVE, options);
+    cartesian_to_packet(buffer, prev_x, prev_y, 0, 0, ELBOW_POSITIVE, options);
+    plan->last_x = prev_x;
+    plan->last_y = prev_y;
+    i += 2;
+  }
 
-  while (fgets(buffer, sizeof(buffer), file))
+#ifdef SMC_FIXED_POINT
+  // The same samples in fixed point, only the increment comes from the arc
+  // length in floating point, once per stroke. The parameter steps in 64 bits,
+  // strokes shorter than the increment, dots too, step past the end at once.
+  FixedBSpline fixed_spline;
+  FixedParameter fixed_us[PIPELINE_CHUNK];
+  int64_t fixed_u = 0, fixed_increment = llround(fmin(increment, 2.0) * FIXED_PARAMETER_ONE);
+  Fixed fixed_xs[PIPELINE_CHUNK], fixed_ys[PIPELINE_CHUNK], last[2] = {0, 0}, capped[2] = {0, 0};
+  Fixed *fixed_points = planner_alloc(arena, sizeof(Fixed) * spline->dim * PIPELINE_CHUNK);
+  int steps1[PIPELINE_CHUNK], steps2[PIPELINE_CHUNK];
+  if (fixed_bspline_init(&fixed_spline, spline, arena) == -1)
   {
-    /* note that fgets don't strip the terminating \n, checking its
-      presence would allow to handle lines longer that sizeof(buffer) */
+    fprintf(stderr,"Error: Fixed Point Spline: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
 
-    size_t len = strlen(buffer);
-    if (SIZE_MAX - len - 1 < full_length)
+  while (fixed_u <= FIXED_PARAMETER_ONE && i < size)
+  {
+    for (n = 0; n < PIPELINE_CHUNK && fixed_u <= FIXED_PARAMETER_ONE && i + n < size; fixed_u += fixed_increment)
     {
-      break;
+      fixed_us[n++] = fixed_u;
     }
-    char *r_temp = realloc(ret, full_length + len + 1);
-    if (r_temp == NULL)
+    fixed_bspline_evaluate_many(&fixed_spline, fixed_us, n, fixed_points);
+
+    for (j = 0; j < n; j++)
     {
-      break;
+      fixed_xs[j] = fixed_points[j * spline->dim] / PPI - FIXED_CONSTANT(8.5);
+      fixed_ys[j] = FIXED_CONSTANT(15) - fixed_points[j * spline->dim + 1] / PPI;
     }
-    ret = r_temp;
-    strcpy(ret + full_length, buffer); /* concatenate */
-    full_length += len;
-    
-    if (feof(file) || buffer[len-1] == '\n')
+    if (options->ik == IK_EXACT)
     {
-      // Complete Toolpath Found
-      char *new_line_char = strchr(ret, '\n');
-      if (new_line_char != NULL || feof(file))
+      for (j = 0; j < n; j++)
+        kinematics_inverse_fixed(fixed_xs[j], fixed_ys[j], ELBOW_POSITIVE, &steps1[j], &steps2[j]);
+    }
+    else
+    {
+      // The float kernels asked for instead
+      for (j = 0; j < n; j++)
+      {
+        xs[j] = fixed_to_float(fixed_xs[j]);
+        ys[j] = fixed_to_float(fixed_ys[j]);
+      }
+      cartesian_to_angles(xs, ys, n, ELBOW_POSITIVE, options, theta1, theta2);
+      for (j = 0; j < n; j++)
       {
-        // Truncate Buffer
-        if (new_line_char != NULL)
-          *new_line_char = '\0';
-
-        // Reset Toolpath Variables
-        found_tool = 0;
-        points = malloc(sizeof(tsRational) * MaxCtrlPointsExtent);
-        count = -1;
+        steps1[j] = floor(theta1[j]);
+        steps2[j] = floor(theta2[j]);
       }
+    }
 
-      // Parsing Tool Number
-      char *pt;
-      if (!found_tool)
+    for (j = 0; j < n; j++)
+    {
+      // A fitted surface is evaluated in floating point
+      const short d3 = options->calibration != NULL
+        ? floor(calibration_height(options->calibration, fixed_to_float(fixed_xs[j]), fixed_to_float(fixed_ys[j])))
+        : cartesian_to_height_fixed(fixed_xs[j], fixed_ys[j]);
+      packet_buffer_append(buffer, steps_to_frame(steps1[j], steps2[j], d3));
+      last[0] = fixed_xs[j];
+      last[1] = fixed_ys[j];
+      // A transition would leave room for size-2 samples
+      if (++n_samples <= size - 2)
       {
-        pt = strtok (ret, ";");
-        if (pt != NULL)
-        {
-          found_tool = 1;
-          tool_number = atoi(pt);
-        }
+        capped[0] = last[0];
+        capped[1] = last[1];
       }
+    }
+    i += n;
+  }
 
-      // Parsing Control Points
-      if (found_tool)
-        pt = strtok (NULL, ",");
-      else
-        pt = strtok (ret, ",");
-      while (pt != NULL) 
+  if (n_samples > 0)
+  {
+    plan->last_x = fixed_to_float(last[0]);
+    plan->last_y = fixed_to_float(last[1]);
+    plan->capped_x = fixed_to_float(capped[0]);
+    plan->capped_y = fixed_to_float(capped[1]);
+  }
+#else
+  u = 0.f;
+  while (u <= 1.f && i < size)
+  {
+    for (n = 0; n < PIPELINE_CHUNK && u <= 1.f && i + n < size; u += increment)
+    {
+      us[n++] = u;
+    }
+
+    err = ts_bspline_evaluate_many(spline, us, n, scratch, points);
+    if (err < 0)
+    {
+      fprintf(stderr,"Error: Spline Evaluation: %s\n", ts_enum_str(err));
+      exit(EXIT_FAILURE);
+    }
+
+    for (j = 0; j < n; j++)
+    {
+      xs[j] = points[j * spline->dim]/PPI - 8.5;
+      ys[j] = 15 - points[j * spline->dim + 1]/PPI;
+    }
+    cartesian_to_angles(xs, ys, n, ELBOW_POSITIVE, options, theta1, theta2);
+
+    for (j = 0; j < n; j++)
+    {
+      tsRational x = xs[j], y = ys[j];
+      packet_buffer_append(buffer, joints_to_frame(theta1[j], theta2[j], cartesian_to_height(x, y, 0, options)));
+      plan->last_x = x;
+      plan->last_y = y;
+      // A transition would leave room for size-2 samples
+      if (++n_samples <= size - 2)
       {
-        count++;
-        points[count] = atof(pt);
-        pt = strtok (NULL, ",");
+        plan->capped_x = x;
+        plan->capped_y = y;
       }
+    }
+    i += n;
+  }
+#endif
+
+  plan->n_frames = n_samples;
+  plan->n_capped = n_samples < size - 2 ? n_samples : size - 2;
+}
 
-      // Checking Compliance for Dimensions of Control Points
-      if (count % 2 == 0)
+// Plans one stroke after the pen position prev_x, prev_y (-1 for none) with
+// the arm in the elbow configuration prev_elbow (-1 for none) and appends its
+// frames to buffer
+void plan_stroke(tsBSpline *spline, float prev_x, float prev_y, int prev_elbow, const PlannerOptions *options, Arena *arena, PacketBuffer *buffer, StrokePlan *plan)
+{
+  // Samples that are not spaced by equal knot steps of de Boor evaluation,
+  // the accuracy report, the simplification, the profile, the choice of the
+  // elbow and the wrist roll need the whole stroke at once
+  plan->duration = 0;
+  plan->n_paced = 0;
+  plan->n_blended = 0;
+  plan->elbow = ELBOW_POSITIVE;
+  memset(&plan->kinematics, 0, sizeof(KinematicsStroke));
+  if (options->sampler == SAMPLER_DE_BOOR && options->spacing == SPACING_PARAMETER && options->accuracy == NULL
+    && options->simplify < 0 && options->profile == NULL && options->elbow == ELBOW_FIXED && options->version == CPV02_VERSION)
+  {
+    spline_to_packets(spline, 0.1f, prev_x, prev_y, options, arena, buffer, plan);
+    return;
+  }
+
+  // Transform Spline to Inverse Kinematics
+  size_t size, i;
+  Trajectory trajectory;
+  spline_to_cartesian(spline, 0.1f, prev_x, prev_y, options, arena, &trajectory, plan);
+  size_t n_transition = trajectory.size - plan->n_frames;
+
+  // The pen-up frames move the arm into the configuration of the stroke
+  Elbow elbow = ELBOW_POSITIVE;
+  if (options->elbow != ELBOW_FIXED)
+  {
+    kinematics_evaluate(trajectory.x + n_transition, trajectory.y + n_transition, plan->n_frames, prev_x, prev_y,
+      options->kinematics, &plan->kinematics);
+    plan->elbow = kinematics_choose(&plan->kinematics, prev_elbow, n_transition > 0, options->kinematics);
+    if (options->elbow == ELBOW_CHOOSE)
+      elbow = plan->elbow;
+  }
+
+  // An elbow that turns over does so with the pen retracted
+  if (prev_elbow != -1 && elbow != (Elbow) prev_elbow && options->elbow == ELBOW_CHOOSE)
+  {
+    for (i = 0; i < n_transition; i++)
+      trajectory.z[i] = -1;
+  }
+  cartesian_to_motor_angles(&trajectory, n_transition, elbow, options);
+
+  // Simplifying, profiling or choosing the elbow of the capped samples does
+  // not give a prefix of the whole stroke's frames, so a stroke that was
+  // capped without its predecessor is planned again in order
+  if (options->simplify >= 0 || options->profile != NULL || options->elbow != ELBOW_FIXED)
+    plan->replan = plan->replan || plan->n_capped < plan->n_frames;
+
+  // The two pen-up frames are identical and collapse into one, the samples
+  // into the frames no straight joint-space move replaces
+  if (options->simplify >= 0)
+  {
+    size_t end = trajectory.size;
+    if (trajectory_simplify(&trajectory, n_transition, &end, options->simplify, arena) == -1
+      || trajectory_simplify(&trajectory, 0, &n_transition, options->simplify, arena) == -1)
+    {
+      fprintf(stderr,"Error: Out of Memory: %s\n", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+    plan->n_frames = plan->n_capped = trajectory.size - n_transition;
+    plan->capped_x = plan->last_x;
+    plan->capped_y = plan->last_y;
+  }
+  size = trajectory.size;
+
+  // Version 3 frames carry no CODE, so no profile either
+  if (options->version == CPV03_VERSION)
+  {
+    for (i = 0; i < size; i++)
+    {
+      packet_buffer_append_v03(buffer, joints_to_frame_v03(trajectory.theta1[i], trajectory.theta2[i], trajectory.theta4[i], trajectory.d3[i]));
+    }
+    return;
+  }
+
+  // Form Packet
+  CPFrameVersion02 *packets = motor_angles_to_packet(&trajectory, arena);
+
+  // The samples run from rest to rest, the pen-up frames and the move onto
+  // the first sample keep the controller's speed
+  if (options->profile != NULL)
+  {
+    double *durations = planner_alloc(arena, sizeof(double) * trajectory.size);
+    unsigned char *blended = planner_alloc(arena, trajectory.size);
+    if (profile_plan(&trajectory, n_transition, options->profile, arena, durations, blended, &plan->duration) == -1)
+    {
+      fprintf(stderr,"Error: Out of Memory: %s\n", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+    for (i = n_transition; i < size; i++)
+    {
+      unsigned char code = duration_to_code(durations[i]);
+      plan->n_paced += code == 0;
+      plan->n_blended += blended[i];
+      frame_set_code(&packets[i], code | (blended[i] ? CPV02_CODE_BLEND : 0));
+    }
+  }
+
+  for (i = 0; i < size; i++)
+  {
+    packet_buffer_append(buffer, packets[i]);
+  }
+}
+
+typedef struct Planner Planner;
+
+typedef struct
+{
+  Planner *planner;
+  pthread_t thread;
+  size_t index;              /* position in the pool */
+  Arena arena;               /* per stroke buffers of the worker */
+  PacketBuffer frames;       /* frames of the strokes planned in this batch */
+  SamplerAccuracy accuracy;  /* merged into the job's report at the end */
+  PlannerOptions options;    /* the job's options reporting into accuracy */
+} PlannerWorker;
+
+// A pool of threads planning the strokes of one batch at a time. Strokes are
+// planned without their predecessor and stitched in order afterwards.
+struct Planner
+{
+  pthread_mutex_t lock;
+  pthread_cond_t work;       /* a batch was published or the pool quits */
+  pthread_cond_t done;       /* the last worker finished the batch */
+  unsigned long generation;  /* number of published batches */
+  int quit;
+  size_t busy;               /* workers still planning the batch */
+  atomic_size_t next;        /* first stroke of the batch nobody claimed */
+  size_t n_strokes;          /* strokes in the batch */
+  tsBSpline *splines;
+  StrokePlan *plans;
+  size_t n_workers;
+  PlannerWorker *workers;
+};
+
+void *planner_worker(void *argument)
+{
+  PlannerWorker *worker = argument;
+  Planner *planner = worker->planner;
+  unsigned long generation = 0;
+  size_t s;
+
+  for (;;)
+  {
+    pthread_mutex_lock(&planner->lock);
+    while (planner->generation == generation && !planner->quit)
+      pthread_cond_wait(&planner->work, &planner->lock);
+    if (planner->quit)
+    {
+      pthread_mutex_unlock(&planner->lock);
+      return NULL;
+    }
+    generation = planner->generation;
+    pthread_mutex_unlock(&planner->lock);
+
+    // Claim strokes one by one, long strokes balance themselves out
+    while ((s = atomic_fetch_add(&planner->next, 1)) < planner->n_strokes)
+    {
+      StrokePlan *plan = &planner->plans[s];
+      plan->first = worker->frames.used;
+      plan->worker = worker->index;
+      plan_stroke(&planner->splines[s], -1, -1, -1, &worker->options, &worker->arena, &worker->frames, plan);
+      arena_reset(&worker->arena);
+    }
+
+    pthread_mutex_lock(&planner->lock);
+    if (--planner->busy == 0)
+      pthread_cond_signal(&planner->done);
+    pthread_mutex_unlock(&planner->lock);
+  }
+}
+
+void planner_start(Planner *planner, size_t n_workers, const PlannerOptions *options)
+{
+  size_t w;
+
+  pthread_mutex_init(&planner->lock, NULL);
+  pthread_cond_init(&planner->work, NULL);
+  pthread_cond_init(&planner->done, NULL);
+  planner->generation = 0;
+  planner->quit = 0;
+  planner->busy = 0;
+  atomic_init(&planner->next, 0);
+  planner->n_strokes = 0;
+  planner->n_workers = n_workers;
+  planner->splines = malloc(sizeof(tsBSpline) * PLANNER_BATCH);
+  planner->plans = malloc(sizeof(StrokePlan) * PLANNER_BATCH);
+  planner->workers = malloc(sizeof(PlannerWorker) * n_workers);
+  if (planner->splines == NULL || planner->plans == NULL || planner->workers == NULL)
+  {
+    fprintf(stderr,"Error: Out of Memory: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  for (w = 0; w < n_workers; w++)
+  {
+    PlannerWorker *worker = &planner->workers[w];
+    worker->planner = planner;
+    worker->index = w;
+    arena_init(&worker->arena, ARENA_MIN_BLOCK);
+    packet_buffer_init(&worker->frames, NULL, options->version == CPV03_VERSION ? CPV03_SIZE : CPV02_SIZE, PACKET_BUFFER_FRAMES);
+    memset(&worker->accuracy, 0, sizeof(SamplerAccuracy));
+    worker->options = *options;
+    if (options->accuracy != NULL)
+      worker->options.accuracy = &worker->accuracy;
+
+    int err = pthread_create(&worker->thread, NULL, planner_worker, worker);
+    if (err != 0)
+    {
+      fprintf(stderr,"Error: Thread Creation: %s\n", strerror(err));
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+// Plans the n_strokes splines of the batch and waits for the workers
+void planner_run(Planner *planner, size_t n_strokes)
+{
+  size_t w;
+  for (w = 0; w < planner->n_workers; w++)
+    planner->workers[w].frames.used = 0;
+
+  pthread_mutex_lock(&planner->lock);
+  planner->n_strokes = n_strokes;
+  atomic_store(&planner->next, 0);
+  planner->busy = planner->n_workers;
+  planner->generation++;
+  pthread_cond_broadcast(&planner->work);
+  while (planner->busy > 0)
+    pthread_cond_wait(&planner->done, &planner->lock);
+  pthread_mutex_unlock(&planner->lock);
+}
+
+// Stops the workers and merges their accuracy into accuracy if not NULL
+void planner_stop(Planner *planner, SamplerAccuracy *accuracy)
+{
+  size_t w;
+
+  pthread_mutex_lock(&planner->lock);
+  planner->quit = 1;
+  pthread_cond_broadcast(&planner->work);
+  pthread_mutex_unlock(&planner->lock);
+
+  for (w = 0; w < planner->n_workers; w++)
+  {
+    PlannerWorker *worker = &planner->workers[w];
+    pthread_join(worker->thread, NULL);
+    if (accuracy != NULL)
+    {
+      accuracy->samples += worker->accuracy.samples;
+      accuracy->sum_squared += worker->accuracy.sum_squared;
+      accuracy->max_error = fmax(accuracy->max_error, worker->accuracy.max_error);
+      accuracy->max_spacing = fmax(accuracy->max_spacing, worker->accuracy.max_spacing);
+      accuracy->max_chord = fmax(accuracy->max_chord, worker->accuracy.max_chord);
+    }
+    arena_free(&worker->arena);
+    packet_buffer_free(&worker->frames);
+  }
+
+  pthread_mutex_destroy(&planner->lock);
+  pthread_cond_destroy(&planner->work);
+  pthread_cond_destroy(&planner->done);
+  free(planner->splines);
+  free(planner->plans);
+  free(planner->workers);
+}
+
+// Adds a stroke emitted with the arm in the elbow configuration previous
+// (-1 for none) to report
+void job_report_add(JobReport *report, const StrokePlan *plan, int previous)
+{
+  const KinematicsStroke *kinematics = &plan->kinematics;
+  const Elbow before = previous == -1 ? plan->elbow : (Elbow) previous;
+
+  report->time += plan->duration;
+  report->paced += plan->n_paced;
+  report->blended += plan->n_blended;
+
+  report->strokes++;
+  // Every stroke was planned in the positive configuration before, a first
+  // stroke in the other one changes it too
+  report->changes += plan->elbow != (previous == -1 ? ELBOW_POSITIVE : (Elbow) previous);
+  report->travel[0] += kinematics->travel[ELBOW_POSITIVE] + kinematics->entry[ELBOW_POSITIVE][ELBOW_POSITIVE];
+  report->travel[1] += kinematics->travel[plan->elbow] + kinematics->entry[before][plan->elbow];
+  report->outside[0] += kinematics->outside[ELBOW_POSITIVE];
+  report->outside[1] += kinematics->outside[plan->elbow];
+}
+
+// Emits a stroke planned without its predecessor as if it had been planned
+// after prev_x, prev_y: the same transition decision on the same floats, the
+// two pen-up frames and the samples that fit after them. Joined strokes
+// continue the previous one without a transition. The elbow is chosen again
+// with the arm in elbow, a stroke planned in the other configuration or
+// planned again replaces its plan.
+void stitch_stroke(Planner *planner, size_t s, int joined, Arena *arena, PacketBuffer *buffer, float *prev_x, float *prev_y, int *elbow)
+{
+  StrokePlan *plan = &planner->plans[s];
+  const PacketBuffer *frames = &planner->workers[plan->worker].frames;
+  const PlannerOptions *options = &planner->workers[plan->worker].options;
+
+  float distance = sqrt(pow(plan->start_x - *prev_x, 2)+pow(plan->start_y - *prev_y, 2));
+  const int lifted = !joined && *prev_x != -1 && distance > 0.1f;
+
+  if (options->elbow != ELBOW_FIXED && !plan->replan)
+  {
+    kinematics_entry(&plan->kinematics, joined ? -1 : *prev_x, joined ? -1 : *prev_y, options->kinematics);
+    Elbow chosen = kinematics_choose(&plan->kinematics, *elbow, lifted, options->kinematics);
+    plan->replan = options->elbow == ELBOW_CHOOSE && chosen != plan->elbow;
+    plan->elbow = chosen;
+  }
+
+  if (plan->replan)
+  {
+    StrokePlan ordered;
+    plan_stroke(&planner->splines[s], joined ? -1 : *prev_x, joined ? -1 : *prev_y, *elbow,
+      options, arena, buffer, &ordered);
+    arena_reset(arena);
+    ordered.worker = plan->worker;
+    *plan = ordered;
+    *prev_x = ordered.last_x;
+    *prev_y = ordered.last_y;
+    *elbow = ordered.elbow;
+    return;
+  }
+
+  if (lifted)
+  {
+    // Simplification keeps one of the identical pen-up frames, an elbow that
+    // turns over does so with the pen retracted
+    const Elbow frames_elbow = options->elbow == ELBOW_CHOOSE ? plan->elbow : ELBOW_POSITIVE;
+    const tsRational z = *elbow != -1 && frames_elbow != (Elbow) *elbow && options->elbow == ELBOW_CHOOSE ? -1 : 0;
+    cartesian_to_packet(buffer, *prev_x, *prev_y, z, plan->heading, frames_elbow, options);
+    if (options->simplify < 0)
+      cartesian_to_packet(buffer, *prev_x, *prev_y, z, plan->heading, frames_elbow, options);
+    packet_buffer_append_many(buffer, packet_buffer_frame(frames, plan->first), plan->n_capped);
+    *prev_x = plan->capped_x;
+    *prev_y = plan->capped_y;
+  }
+  else
+  {
+    packet_buffer_append_many(buffer, packet_buffer_frame(frames, plan->first), plan->n_frames);
+    *prev_x = plan->last_x;
+    *prev_y = plan->last_y;
+  }
+  *elbow = plan->elbow;
+}
+
+// Reads the next stroke of reader and sets up its spline, returning the
+// status of curves_next. borrowed is set if the spline borrows the mapping.
+int read_stroke(CurvesReader *reader, const char *curves_file, tsBSpline *spline, int *borrowed)
+{
+  CurvesStroke stroke;
+  int status = curves_next(reader, &stroke);
+  if (status != 1)
+    return status;
+
+  // Checking Compliance for Dimensions of Control Points
+  if (stroke.n_values < 4 || stroke.n_values % 2 != 0)
+  {
+    fprintf(stderr,"Error %s:%zu: Improperly Defined Bezier Curve\n", curves_file, reader->line);
+    exit(EXIT_FAILURE);
+  }
+
+  // Building Spline
+  int err = curves_stroke_spline(&stroke, spline);
+  if (err < 0)
+  {
+    fprintf(stderr,"Error %s:%zu: %s\n", curves_file, reader->line, ts_enum_str(err));
+    exit(EXIT_FAILURE);
+  }
+  *borrowed = err;
+  return 1;
+}
+
+void stroke_list_load(StrokeList *list, CurvesReader *reader, const char *curves_file)
+{
+  tsBSpline spline;
+  int borrowed, status;
+
+  list->n_strokes = list->capacity = list->next = 0;
+  list->splines = NULL;
+  list->borrowed = NULL;
+  while ((status = read_stroke(reader, curves_file, &spline, &borrowed)) == 1)
+  {
+    if (list->n_strokes == list->capacity)
+    {
+      list->capacity = list->capacity ? list->capacity * 2 : 1024;
+      list->splines = realloc(list->splines, sizeof(tsBSpline) * list->capacity);
+      list->borrowed = realloc(list->borrowed, sizeof(int) * list->capacity);
+      if (list->splines == NULL || list->borrowed == NULL)
       {
-        fprintf(stderr,"Error %s: Improperly Defined Bezier Curve\n", curves_file);
+        fprintf(stderr,"Error: Out of Memory: %s\n", strerror(errno));
         exit(EXIT_FAILURE);
       }
+    }
+    list->splines[list->n_strokes] = spline;
+    list->borrowed[list->n_strokes++] = borrowed;
+  }
+
+  if (status == -1)
+  {
+    fprintf(stderr,"Error %s:%zu: %s\n", curves_file, reader->line, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Chains strokes of list whose ends meet and/or puts the strokes (or the
+// chains) into the order with the least pen-up travel, replacing strokes
+// drawn from end to start by reversed copies
+void stroke_list_arrange(StrokeList *list, const PlannerOptions *options)
+{
+  const size_t n = list->n_strokes;
+  size_t k;
+
+  list->joined = calloc(n > 0 ? n : 1, 1);
+  if (list->joined == NULL)
+  {
+    fprintf(stderr,"Error: Out of Memory: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  if (n < 2)
+    return;
+
+  OrderingStroke *strokes = malloc(sizeof(OrderingStroke) * n);
+  size_t *order = malloc(sizeof(size_t) * n);
+  unsigned char *reversed = calloc(n, 1);
+  tsBSpline *splines = malloc(sizeof(tsBSpline) * n);
+  int *borrowed = malloc(sizeof(int) * n);
+  if (strokes == NULL || order == NULL || reversed == NULL || splines == NULL || borrowed == NULL)
+  {
+    fprintf(stderr,"Error: Out of Memory: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  // Clamped strokes start and end at their first and last control point
+  for (k = 0; k < n; k++)
+  {
+    const tsBSpline *spline = &list->splines[k];
+    const tsRational *last = spline->ctrlp + (spline->n_ctrlp - 1) * spline->dim;
+    strokes[k].start[0] = spline->ctrlp[0];
+    strokes[k].start[1] = spline->ctrlp[1];
+    strokes[k].end[0] = last[0];
+    strokes[k].end[1] = last[1];
+    order[k] = k;
+  }
 
-      // Building Spline
-      tsBSpline spline;
-      ts_bspline_new(
-        (count/3 == 1) ? 1 : 3,      /* degree of spline */
-        2,      /* dimension of each point */
-        (count+1)/2,      /* number of control points */
-        TS_CLAMPED, /* used to hit first and last control point */
-        &spline /* the spline to setup */
-      );
-
-      // Setup Control Points
-      size_t i;
-      for (i = 0; i < count+1; i++)
+  size_t n_chains = n;
+  if (options->chain_tolerance > 0)
+  {
+    n_chains = ordering_chain(strokes, n, options->chain_tolerance * PPI, order, reversed, list->joined);
+    if (n_chains == (size_t) -1)
+    {
+      fprintf(stderr,"Error: Out of Memory: %s\n", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (options->reorder)
+  {
+    // Order the chains, each one entered at its first stroke's start and
+    // left at its last stroke's end
+    OrderingStroke *chains = malloc(sizeof(OrderingStroke) * n_chains);
+    size_t *first = malloc(sizeof(size_t) * (n_chains + 1));
+    size_t *chain_order = malloc(sizeof(size_t) * n_chains);
+    unsigned char *chain_reversed = malloc(n_chains);
+    size_t *arranged = malloc(sizeof(size_t) * n);
+    unsigned char *joined = malloc(n);
+    size_t c, m = 0;
+    if (chains == NULL || first == NULL || chain_order == NULL || chain_reversed == NULL || arranged == NULL || joined == NULL)
+    {
+      fprintf(stderr,"Error: Out of Memory: %s\n", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+
+    for (c = 0, k = 0; k < n; k++)
+    {
+      if (list->joined[k])
+        continue;
+      first[c++] = k;
+    }
+    first[n_chains] = n;
+    for (c = 0; c < n_chains; c++)
+    {
+      const size_t head = order[first[c]], tail = order[first[c+1] - 1];
+      const float *entry = reversed[head] ? strokes[head].end : strokes[head].start;
+      const float *exit = reversed[tail] ? strokes[tail].start : strokes[tail].end;
+      chains[c].start[0] = entry[0];
+      chains[c].start[1] = entry[1];
+      chains[c].end[0] = exit[0];
+      chains[c].end[1] = exit[1];
+    }
+
+    if (ordering_plan(chains, n_chains, chain_order, chain_reversed) == -1)
+    {
+      fprintf(stderr,"Error: Out of Memory: %s\n", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+
+    // A reversed chain is drawn from its last stroke back, every stroke in
+    // the other direction
+    for (c = 0; c < n_chains; c++)
+    {
+      const size_t chain = chain_order[c];
+      for (k = first[chain]; k < first[chain+1]; k++)
       {
-        spline.ctrlp[i] = points[i];
+        const size_t at = chain_reversed[chain] ? first[chain+1] - 1 - (k - first[chain]) : k;
+        arranged[m] = order[at];
+        joined[m++] = k > first[chain];
+        if (chain_reversed[chain])
+          reversed[order[at]] ^= 1;
       }
+    }
+    memcpy(order, arranged, sizeof(size_t) * n);
+    memcpy(list->joined, joined, n);
+    free(chains);
+    free(first);
+    free(chain_order);
+    free(chain_reversed);
+    free(arranged);
+    free(joined);
+  }
 
-      // Transform Spline to Inverse Kinematics
-      size_t size;
-      tsRational **cartesian, **transformation;
-      cartesian = spline_to_cartesian(&spline, 0.1f, &size, prev_x, prev_y);
-      transformation = cartesian_to_motor_angles(cartesian, size);
+  size_t n_reversed = 0;
+  for (k = 0; k < n; k++)
+  {
+    const size_t s = order[k];
+    if (!reversed[s])
+    {
+      splines[k] = list->splines[s];
+      borrowed[k] = list->borrowed[s];
+      continue;
+    }
 
-      // Save Old Packets
-      prev_x = cartesian[size-1][0];
-      prev_y = cartesian[size-1][1];
+    tsError err = ordering_reverse_spline(&list->splines[s], &splines[k]);
+    if (err < 0)
+    {
+      fprintf(stderr,"Error: Stroke Order: %s\n", ts_enum_str(err));
+      exit(EXIT_FAILURE);
+    }
+    borrowed[k] = 0;
+    if (!list->borrowed[s])
+      ts_bspline_free(&list->splines[s]);
+    n_reversed++;
+  }
 
-      // Form Packet
-      CPFrameVersion02 *packets = motor_angles_to_packet(transformation, size);
+  // Moves longer than 0.1 in lift the pen, chained strokes never do
+  double before = ordering_travel(strokes, n, NULL, NULL) / PPI;
+  double after = ordering_travel(strokes, n, order, reversed) / PPI;
+  size_t lifts_before = ordering_gaps(strokes, n, NULL, NULL, 0.1 * PPI);
+  size_t lifts_after = ordering_gaps(strokes, n, order, reversed, 0.1 * PPI);
+  fprintf(stderr,"Stroke Order: <%zu> strokes in %zu chains, %zu reversed, pen-up travel %.1f in -> %.1f in (%.1f in saved), pen lifts %zu -> %zu\n",
+    n, n_chains, n_reversed, before, after, before - after, lifts_before, lifts_after);
+
+  free(list->splines);
+  free(list->borrowed);
+  list->splines = splines;
+  list->borrowed = borrowed;
+  free(strokes);
+  free(order);
+  free(reversed);
+}
 
-      for (i = 0; i < size; i++)
+// Hands out the next stroke of list like read_stroke, joined is set if it
+// continues the previous stroke
+int stroke_list_next(StrokeList *list, tsBSpline *spline, int *borrowed, int *joined)
+{
+  if (list->next == list->n_strokes)
+    return 0;
+  *spline = list->splines[list->next];
+  *joined = list->joined[list->next];
+  *borrowed = list->borrowed[list->next++];
+  return 1;
+}
+
+// Upper bound of the frames of a job, from the control polygons which are
+// never shorter than their strokes. Adaptive spacing is not bound by the
+// length, for it the bound is only a first estimate.
+size_t motion_planning_frames(const char *curves_file)
+{
+  CurvesReader reader;
+  CurvesStroke stroke;
+  size_t frames = 1, j; // the home frame
+
+  if (curves_open(curves_file, &reader) == -1)
+    return 0;
+  while (curves_next(&reader, &stroke) == 1)
+  {
+    double length = 0;
+    for (j = 2; j + 1 < stroke.n_values; j += 2)
+    {
+      length += linear_length(stroke.ctrlp[j], stroke.ctrlp[j+1], stroke.ctrlp[j-2], stroke.ctrlp[j-1]);
+    }
+    // 1/increment + 1 samples and the transition, with room for rounding
+    frames += length / PPI / 0.1 + 4;
+  }
+  curves_close(&reader);
+  return frames;
+}
+
+int motion_planning_packets(const char *curves_file, const char *packets_file, PacketsMode mode, const PlannerOptions *options, size_t n_workers)
+{
+  CurvesReader reader;
+  if (curves_open(curves_file, &reader) == -1)
+  {
+    fprintf(stderr,"File Null Error <%s>: %s\n", curves_file, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  // The mapping is sized for the whole job up front
+  PacketWriter writer;
+  const size_t frame_size = options->version == CPV03_VERSION ? CPV03_SIZE : CPV02_SIZE;
+  size_t expected = mode == PACKETS_MMAP ? motion_planning_frames(curves_file) : 0;
+  if (packets_open(&writer, packets_file, mode, frame_size, expected) == -1)
+  {
+    fprintf(stderr,"File Null Error <%s>: %s\n", packets_file, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  PacketBuffer buffer;
+  packet_buffer_init(&buffer, &writer, frame_size, 0);
+
+  crcInit();
+  srand(time(NULL));   // should only be called once
+
+  int status;
+
+  // Per stroke buffers, reused once the first strokes sized the arena
+  Arena arena;
+  arena_init(&arena, ARENA_MIN_BLOCK);
+
+  float prev_x, prev_y;
+  prev_x = -1;
+  prev_y = -1;
+
+  // The arm starts in no particular configuration
+  int elbow = -1;
+  JobReport report;
+  memset(&report, 0, sizeof(JobReport));
+
+  // Reordering and chaining need every stroke before the first is drawn
+  StrokeList list;
+  const int arranged = options->reorder || options->chain_tolerance > 0;
+  if (arranged)
+  {
+    stroke_list_load(&list, &reader, curves_file);
+    stroke_list_arrange(&list, options);
+  }
+
+  // With more than one worker, strokes are read in batches that the pool
+  // plans while this thread waits, then stitched in order
+  Planner planner;
+  int borrowed[PLANNER_BATCH], joined[PLANNER_BATCH];
+  size_t n_batch = 0, s;
+  if (n_workers > 1)
+    planner_start(&planner, n_workers, options);
+
+  for (;;)
+  {
+    tsBSpline spline;
+    int borrowed_spline, joined_stroke = 0;
+    if (arranged)
+      status = stroke_list_next(&list, &spline, &borrowed_spline, &joined_stroke);
+    else
+      status = read_stroke(&reader, curves_file, &spline, &borrowed_spline);
+
+    if (n_workers > 1 && (n_batch == PLANNER_BATCH || (status != 1 && n_batch > 0)))
+    {
+      planner_run(&planner, n_batch);
+      for (s = 0; s < n_batch; s++)
       {
-        size_t bytes_written = fwrite(&packets[i], sizeof(CPFrameVersion02), 1, packets_buffer);
-        if (bytes_written != 1)
-        {
-          fprintf(stderr,"Error: File Write Operation\n");
-          exit(EXIT_FAILURE);
-        }
+        const int previous = elbow;
+        stitch_stroke(&planner, s, joined[s], &arena, &buffer, &prev_x, &prev_y, &elbow);
+        job_report_add(&report, &planner.plans[s], previous);
+        if (!borrowed[s])
+          ts_bspline_free(&planner.splines[s]);
       }
+      n_batch = 0;
+    }
+    if (status != 1)
+      break;
+
+    if (n_workers > 1)
+    {
+      planner.splines[n_batch] = spline;
+      joined[n_batch] = joined_stroke;
+      borrowed[n_batch++] = borrowed_spline;
+      continue;
+    }
 
-      // Clean Up
-      cartesian = destroy_cartesian(cartesian, size);
-      transformation = destroy_cartesian(transformation, size);
-      free(packets);
+    // A chained stroke goes on from where the last one ended
+    StrokePlan plan;
+    plan_stroke(&spline, joined_stroke ? -1 : prev_x, joined_stroke ? -1 : prev_y, elbow, options, &arena, &buffer, &plan);
+
+    // Save Old Packets
+    prev_x = plan.last_x;
+    prev_y = plan.last_y;
+    job_report_add(&report, &plan, elbow);
+    elbow = plan.elbow;
+
+    // Clean Up, everything of the stroke lives in the arena
+    arena_reset(&arena);
+    if (!borrowed_spline)
       ts_bspline_free(&spline);
-      free(points);
-      free(ret); ret = (char *) NULL;
-      full_length = 0;
+  }
 
-    }
+  if (n_workers > 1)
+    planner_stop(&planner, options->accuracy);
+
+  if (status == -1)
+  {
+    fprintf(stderr,"Error %s:%zu: %s\n", curves_file, reader.line, strerror(errno));
+    exit(EXIT_FAILURE);
   }
 
+  if (options->version == CPV03_VERSION)
+  {
+    packet_buffer_append_v03(&buffer, joints_to_frame_v03(686, 0, 0, ZParkPlane));
+  }
+  else
   {
-    CPFrameVersion02 frame = {StartFrameDelimiter, CPV02_VERSION, 0, 686, 0, 50, 0, EndOfFrame};
+    CPFrameVersion02 frame = {StartFrameDelimiter, CPV02_VERSION, 0, 686, 0, ZParkPlane, 0, EndOfFrame};
     frame.CRC = crcFast((unsigned char *) &frame, CPV02_SIZE-3);
 
-    size_t bytes_written = fwrite(&frame, sizeof(CPFrameVersion02), 1, packets_buffer);
-    if (bytes_written != 1)
-    {
-      fprintf(stderr,"Error: File Write Operation\n");
-      exit(EXIT_FAILURE);
-    }
+    packet_buffer_append(&buffer, frame);
   }
 
-  // if (feof(file))
-  // {
-  //   fprintf(stderr,"File EOF Error %s: %s\n", packets_buffer_file, strerror(errno));
-  //   exit(EXIT_FAILURE);
-  // }
+  if (options->accuracy != NULL && options->accuracy->samples > 0)
+  {
+    SamplerAccuracy *accuracy = options->accuracy;
+    fprintf(stderr,"Sampler Accuracy: <%zu> samples, max deviation %.3g in, rms %.3g in, max spacing %.3g in, max chord deviation %.3g in (resolution 0.1 in)\n",
+      accuracy->samples, accuracy->max_error, sqrt(accuracy->sum_squared / accuracy->samples), accuracy->max_spacing, accuracy->max_chord);
+  }
+
+  if (options->profile != NULL)
+  {
+    fprintf(stderr,"Velocity Profile: predicted drawing time %.1f s (%d:%02d), %zu sample frames and the pen-up moves at the controller's speed\n",
+      report.time, (int) (report.time / 60), (int) fmod(report.time, 60), report.paced);
+    if (options->profile->deviation > 0)
+      fprintf(stderr,"Corner Blending: <%zu> frames passed through within %.3g in\n",
+        report.blended, options->profile->deviation / BlendStepsPerInch);
+  }
+
+  if (options->elbow != ELBOW_FIXED)
+  {
+    double saved = report.travel[0] - report.travel[1];
+    fprintf(stderr,"Elbow Configuration: <%zu> strokes, %zu changes of configuration%s, joint travel %.0f -> %.0f steps (%.1f%% saved), samples beyond the joint limits %zu -> %zu\n",
+      report.strokes, report.changes, options->elbow == ELBOW_REPORT ? " (not applied)" : "", report.travel[0], report.travel[1],
+      report.travel[0] > 0 ? 100 * saved / report.travel[0] : 0, report.outside[0], report.outside[1]);
+  }
 
-  // Clean Up
-  fclose(file);
-  fclose(packets_buffer);
-  free(ret);
+  // Clean Up, writing the last frames
+  if (arranged)
+  {
+    free(list.splines);
+    free(list.borrowed);
+    free(list.joined);
+  }
+  packet_buffer_free(&buffer);
+  arena_free(&arena);
+  curves_close(&reader);
   return EXIT_SUCCESS;
 }
 
-int main(int argc, char** argv)
+void usage(const char *program)
 {
+  fprintf(stdout,"Usage: %s [-s deboor|forward] [-d parameter|distance|adaptive] [-t tolerance] [-m max segment] [-a] [-r] [-c tolerance] [-e steps] [-v] [-b tolerance] [-k choose|report] [-f | -g | -i] [-p 2|3] [-z calibration file] [-j threads] [-w buffered|mmap] <curves file> <packets file>\n", program);
+  fprintf(stdout,"       %s [options] -o <packets file> <curves file>\n", program);
+  fprintf(stdout,"       %s replan-z <calibration file> <packets file>...\n", program);
+  fprintf(stdout,"  -s  sampler used along each stroke (default deboor)\n");
+  fprintf(stdout,"  -d  space samples by equal knot steps, equal distances or adaptively (default parameter)\n");
+  fprintf(stdout,"      forward differencing needs equal knot steps\n");
+  fprintf(stdout,"  -t  largest chord deviation of adaptive spacing in inches (default %g)\n", AdaptiveTolerance);
+  fprintf(stdout,"  -m  longest segment of adaptive spacing in inches (default %g)\n", AdaptiveMaxSegment);
+  fprintf(stdout,"  -a  report the deviation and spacing of the samples\n");
+  fprintf(stdout,"  -r  reorder and reverse strokes to shorten the pen-up travel\n");
+  fprintf(stdout,"  -c  chain strokes whose ends meet within tolerance inches (at most 0.1)\n");
+  fprintf(stdout,"  -e  drop frames within steps encoder steps of a straight joint-space move\n");
+  fprintf(stdout,"  -v  plan joint speeds and ask for the duration of every move, reporting the drawing time\n");
+  fprintf(stdout,"  -b  pass through corners on blends that keep within tolerance inches, implies -v\n");
+  fprintf(stdout,"  -k  choose the elbow configuration per stroke for the least joint travel, or report what it saves\n");
+  fprintf(stdout,"  -f  vectorized inverse kinematics, joints at most one encoder step off\n");
+  fprintf(stdout,"  -g  inverse kinematics interpolated in a grid over the workspace, joints at most one encoder step off\n");
+  fprintf(stdout,"  -i  incremental inverse kinematics from sample to sample, joints at most one encoder step off\n");
+  fprintf(stdout,"  -p  frame version, 3 adds the wrist and rolls the brush along the stroke (default 2)\n");
+  fprintf(stdout,"      version 3 frames have no CODE, so no -v or -b\n");
+  fprintf(stdout,"  -z  heights of the actuator from the surface fitted to a calibration file\n");
+  fprintf(stdout,"  -j  number of planning threads, 0 for one per processor (default 1)\n");
+  fprintf(stdout,"  -w, --writer  write the packets file in blocks or through a mapping (default buffered)\n");
+  fprintf(stdout,"  -o, --output  packets file, - for the standard output\n");
+  fprintf(stdout,"  replan-z  rewrite the heights of planned packets files in place for a new calibration\n");
+  exit(EXIT_FAILURE);
+}
 
-  if (argc != 3)
+// Reads a calibration file over the constants, reporting the fit
+void load_calibration(Calibration *calibration, const char *calibration_file)
+{
+  size_t line;
+
+  calibration->retract = ZRetractPlane;
+  calibration->lifted = ZParkPlane;
+  if (calibration_load(calibration, calibration_file, &line) == -1)
   {
-    fprintf(stdout,"Usage: %s <curves file> <packets file>\n", argv[0]);
+    if (line > 0)
+      fprintf(stderr,"Error %s:%zu: %s\n", calibration_file, line, strerror(errno));
+    else
+      fprintf(stderr,"Error: Calibration <%s>: %s\n", calibration_file, strerror(errno));
     exit(EXIT_FAILURE);
   }
+  fprintf(stderr,"Calibration: degree %d surface fitted to <%zu> heights, rms %.3g, max %.3g off\n",
+    calibration->degree, calibration->n_points, calibration->rms, calibration->max_error);
+}
+
+// Rewrites the heights of packets files for a new calibration, the joints
+// stay as they were planned
+int replan_z(const char *program, int argc, char** argv)
+{
+  Calibration calibration;
+  CalibrationReplan report;
+  size_t frames = 0, changed = 0, files = 0;
+  int i, status = EXIT_SUCCESS;
+
+  if (argc < 3)
+    usage(program);
+  load_calibration(&calibration, argv[1]);
+  crcInit();
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i = 2; i < argc; i++)
+  {
+    if (calibration_replan(&calibration, argv[i], &report) == -1)
+    {
+      // The other files are still worth replanning
+      fprintf(stderr,"Error: Replan Z <%s>: %s\n", argv[i], errno == EILSEQ ? "corrupted frame, file left as it was" : strerror(errno));
+      status = EXIT_FAILURE;
+      continue;
+    }
+    files++;
+    frames += report.frames;
+    changed += report.changed;
+    fprintf(stderr,"Replan Z: <%s> %zu frames, %zu heights changed, %zu off the paper kept\n",
+      argv[i], report.frames, report.changed, report.kept);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  fprintf(stderr,"Replan Z: <%zu> files, %zu frames, %zu heights changed in %.3f s\n", files, frames, changed,
+    (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9);
+  return status;
+}
+
+int main(int argc, char** argv)
+{
+  PlannerOptions options = {SAMPLER_DE_BOOR, SPACING_PARAMETER, AdaptiveTolerance, AdaptiveMaxSegment, NULL, 0, 0, -1, NULL, ELBOW_FIXED, NULL, IK_EXACT, NULL, CPV02_VERSION, NULL};
+  SamplerAccuracy accuracy = {0, 0, 0, 0, 0};
+  static const KinematicsLimits kinematics = {
+    {-ShoulderPanLimit * StepsPerRadian, -ElbowPanLimit * StepsPerRadian},
+    {ShoulderPanLimit * StepsPerRadian, ElbowPanLimit * StepsPerRadian},
+    ElbowHysteresis
+  };
+  ProfileLimits limits = {
+    {Theta1Velocity, Theta2Velocity, D3Velocity},
+    {Theta1Acceleration, Theta2Acceleration, D3Acceleration},
+    {Theta1Jerk, Theta2Jerk, D3Jerk},
+    JunctionTime, 0
+  };
+  KinematicsGrid grid;
+  Calibration calibration;
+  const char *calibration_file = NULL;
+  long n_workers = 1;
+  int status;
+  PacketsMode mode = PACKETS_BUFFERED;
+  const char *packets_file = NULL;
+
+  static const struct option long_options[] = {
+    {"output", required_argument, NULL, 'o'},
+    {"writer", required_argument, NULL, 'w'},
+    {NULL, 0, NULL, 0}
+  };
+
+  if (argc > 1 && strcmp(argv[1], "replan-z") == 0)
+    return replan_z(argv[0], argc - 1, argv + 1);
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "s:d:t:m:arc:e:vb:k:fgip:z:j:w:o:", long_options, NULL)) != -1)
+  {
+    switch (opt)
+    {
+      case 's':
+        if (strcmp(optarg, "deboor") == 0)
+          options.sampler = SAMPLER_DE_BOOR;
+        else if (strcmp(optarg, "forward") == 0)
+          options.sampler = SAMPLER_FORWARD_DIFFERENCES;
+        else
+          usage(argv[0]);
+        break;
+      case 'd':
+        if (strcmp(optarg, "parameter") == 0)
+          options.spacing = SPACING_PARAMETER;
+        else if (strcmp(optarg, "distance") == 0)
+          options.spacing = SPACING_DISTANCE;
+        else if (strcmp(optarg, "adaptive") == 0)
+          options.spacing = SPACING_ADAPTIVE;
+        else
+          usage(argv[0]);
+        break;
+      case 't':
+        options.tolerance = atof(optarg);
+        if (options.tolerance <= 0)
+          usage(argv[0]);
+        break;
+      case 'm':
+        options.max_segment = atof(optarg);
+        if (options.max_segment <= 0)
+          usage(argv[0]);
+        break;
+      case 'a':
+        options.accuracy = &accuracy;
+        break;
+      case 'r':
+        options.reorder = 1;
+        break;
+      case 'c':
+        options.chain_tolerance = atof(optarg);
+        if (options.chain_tolerance <= 0 || options.chain_tolerance > 0.1)
+          usage(argv[0]);
+        break;
+      case 'e':
+        options.simplify = atof(optarg);
+        if (options.simplify < 0)
+          usage(argv[0]);
+        break;
+      case 'v':
+        options.profile = &limits;
+        break;
+      case 'b':
+        limits.deviation = atof(optarg) * BlendStepsPerInch;
+        if (limits.deviation <= 0)
+          usage(argv[0]);
+        options.profile = &limits;
+        break;
+      case 'k':
+        if (strcmp(optarg, "choose") == 0)
+          options.elbow = ELBOW_CHOOSE;
+        else if (strcmp(optarg, "report") == 0)
+          options.elbow = ELBOW_REPORT;
+        else
+          usage(argv[0]);
+        options.kinematics = &kinematics;
+        break;
+      case 'f':
+        options.ik = IK_VECTORIZED;
+        break;
+      case 'g':
+        options.ik = IK_GRID;
+        break;
+      case 'i':
+        options.ik = IK_INCREMENTAL;
+        break;
+      case 'p':
+        if (strcmp(optarg, "2") == 0)
+          options.version = CPV02_VERSION;
+        else if (strcmp(optarg, "3") == 0)
+          options.version = CPV03_VERSION;
+        else
+          usage(argv[0]);
+        break;
+      case 'z':
+        calibration_file = optarg;
+        break;
+      case 'j':
+        n_workers = atol(optarg);
+        if (n_workers == 0)
+          n_workers = sysconf(_SC_NPROCESSORS_ONLN);
+        if (n_workers < 1)
+          usage(argv[0]);
+        break;
+      case 'w':
+        if (strcmp(optarg, "buffered") == 0)
+          mode = PACKETS_BUFFERED;
+        else if (strcmp(optarg, "mmap") == 0)
+          mode = PACKETS_MMAP;
+        else
+          usage(argv[0]);
+        break;
+      case 'o':
+        packets_file = optarg;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+
+  if (argc - optind != (packets_file == NULL ? 2 : 1) || (options.sampler == SAMPLER_FORWARD_DIFFERENCES && options.spacing != SPACING_PARAMETER)
+    || (options.version == CPV03_VERSION && options.profile != NULL))
+  {
+    usage(argv[0]);
+  }
+  if (packets_file == NULL)
+  {
+    packets_file = argv[optind+1];
+  }
+
+  if (calibration_file != NULL)
+  {
+    load_calibration(&calibration, calibration_file);
+    options.calibration = &calibration;
+  }
+
+  if (options.ik == IK_GRID)
+  {
+    // Over everything the arm reaches, pen positions off the page included
+    const double reach = ShoulderPanLinkLength + ElbowPanLinkLength;
+    if (kinematics_grid_new(&grid, -reach, -reach, reach, reach, IKGridSpacing, IKGridTolerance) == -1)
+    {
+      fprintf(stderr,"Error: could not set up the IK grid: %s\n", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+    options.grid = &grid;
+    fprintf(stderr,"IK Grid: %zu x %zu nodes, %zu and %zu cells solved exactly\n", grid.columns, grid.rows,
+      grid.n_exact[ELBOW_POSITIVE], grid.n_exact[ELBOW_NEGATIVE]);
+  }
 
-  return motion_planning_packets(argv[1], argv[2]);
+  status = motion_planning_packets(argv[optind], packets_file, mode, &options, n_workers);
+  if (options.ik == IK_GRID)
+    kinematics_grid_free(&grid);
+  return status;
 }
@@ -0,0 +1,664 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "ordering.h"
+
+#define ORDERING_MIN_GAIN 1e-6 /* shortest improvement a 2-opt move must make */
+#define ORDERING_MAX_REVERSAL 25000 /* longest run of strokes a 2-opt move may reverse */
+
+// A uniform grid over the 2n end points, endpoint 2s is the start of stroke
+// s and 2s+1 its end. Cells are stored back to back and endpoints removed by
+// the nearest neighbour walk are swapped behind the used part of their cell.
+typedef struct
+{
+  const OrderingStroke* strokes;
+  float min_x, min_y;
+  float cell;         /* width and height of a cell */
+  size_t nx, ny;
+  size_t* first;      /* first slot of every cell, nx*ny+1 entries */
+  size_t* count;      /* endpoints still in every cell */
+  size_t* items;      /* endpoints grouped by cell */
+  size_t* slot;       /* position of every endpoint in items */
+} OrderingGrid;
+
+// End points bucketed by their position quantized to the chaining
+// tolerance. An open addressing table maps every occupied bucket to its run
+// of endpoints, stored back to back like the cells of the grid.
+typedef struct
+{
+  const OrderingStroke* strokes;
+  double tolerance;
+  size_t mask;        /* size of table - 1 */
+  size_t* table;      /* bucket of every slot, SIZE_MAX if empty */
+  long long* keys;    /* quantized x and y of every bucket */
+  size_t* first;      /* first slot of every bucket */
+  size_t* count;      /* endpoints still in every bucket */
+  size_t* items;      /* endpoints grouped by bucket */
+  size_t* slot;       /* position of every endpoint in items */
+  size_t* bucket;     /* bucket of every endpoint */
+} OrderingHash;
+
+// The path as a cycle through the strokes and a depot, stroke n, that is
+// zero distance from everything. Cutting the cycle at the depot gives the
+// open path, and either side of a 2-opt move can be reversed.
+typedef struct
+{
+  const OrderingStroke* strokes;
+  size_t n;
+  size_t* tour;           /* stroke at every position, n+1 entries */
+  size_t* pos;            /* position of every stroke */
+  unsigned char* flip;    /* stroke drawn from end to start */
+} OrderingTour;
+
+static inline const float* ordering_point(const OrderingStroke* strokes, size_t endpoint)
+{
+  return endpoint & 1 ? strokes[endpoint >> 1].end : strokes[endpoint >> 1].start;
+}
+
+static inline double ordering_distance(const float* a, const float* b)
+{
+  double dx = a[0] - b[0], dy = a[1] - b[1];
+  return sqrt(dx*dx + dy*dy);
+}
+
+static inline size_t ordering_cell_index(const OrderingGrid* grid, const float* point)
+{
+  size_t cx = (point[0] - grid->min_x) / grid->cell;
+  size_t cy = (point[1] - grid->min_y) / grid->cell;
+  if (cx >= grid->nx)
+    cx = grid->nx - 1;
+  if (cy >= grid->ny)
+    cy = grid->ny - 1;
+  return cy * grid->nx + cx;
+}
+
+static void ordering_grid_free(OrderingGrid* grid)
+{
+  free(grid->first);
+  free(grid->count);
+  free(grid->items);
+  free(grid->slot);
+}
+
+static int ordering_grid_new(const OrderingStroke* strokes, size_t n, OrderingGrid* grid)
+{
+  const size_t n_points = 2 * n;
+  float max_x, max_y;
+  size_t e, c;
+
+  grid->strokes = strokes;
+  grid->min_x = max_x = strokes[0].start[0];
+  grid->min_y = max_y = strokes[0].start[1];
+  for (e = 0; e < n_points; e++)
+  {
+    const float* point = ordering_point(strokes, e);
+    grid->min_x = fminf(grid->min_x, point[0]);
+    grid->min_y = fminf(grid->min_y, point[1]);
+    max_x = fmaxf(max_x, point[0]);
+    max_y = fmaxf(max_y, point[1]);
+  }
+
+  // About two endpoints per cell
+  double width = fmax(max_x - grid->min_x, 1e-3), height = fmax(max_y - grid->min_y, 1e-3);
+  grid->cell = sqrt(width * height / n);
+  grid->nx = width / grid->cell + 1;
+  grid->ny = height / grid->cell + 1;
+
+  const size_t n_cells = grid->nx * grid->ny;
+  grid->first = calloc(n_cells + 1, sizeof(size_t));
+  grid->count = calloc(n_cells, sizeof(size_t));
+  grid->items = malloc(sizeof(size_t) * n_points);
+  grid->slot = malloc(sizeof(size_t) * n_points);
+  if (grid->first == NULL || grid->count == NULL || grid->items == NULL || grid->slot == NULL)
+  {
+    ordering_grid_free(grid);
+    return -1;
+  }
+
+  // Counting sort of the endpoints by cell
+  for (e = 0; e < n_points; e++)
+    grid->count[ordering_cell_index(grid, ordering_point(strokes, e))]++;
+  for (c = 0; c < n_cells; c++)
+    grid->first[c+1] = grid->first[c] + grid->count[c];
+  for (c = 0; c < n_cells; c++)
+    grid->count[c] = 0;
+  for (e = 0; e < n_points; e++)
+  {
+    c = ordering_cell_index(grid, ordering_point(strokes, e));
+    grid->slot[e] = grid->count[c];
+    grid->items[grid->first[c] + grid->count[c]++] = e;
+  }
+  return 0;
+}
+
+// Swaps \endpoint behind the used part of its run of \items
+static void ordering_remove(size_t* items, size_t* count, size_t* slot, size_t endpoint)
+{
+  const size_t last = items[*count - 1];
+  items[slot[endpoint]] = last;
+  slot[last] = slot[endpoint];
+  items[*count - 1] = endpoint;
+  slot[endpoint] = *count - 1;
+  (*count)--;
+}
+
+static void ordering_grid_remove(OrderingGrid* grid, size_t endpoint)
+{
+  const size_t c = ordering_cell_index(grid, ordering_point(grid->strokes, endpoint));
+  ordering_remove(grid->items + grid->first[c], &grid->count[c], grid->slot, endpoint);
+}
+
+// Collects up to k endpoints closest to \point, nearest first, skipping the
+// endpoints of stroke \skip. Rings of cells around the point are searched
+// until no unsearched cell can hold anything closer than the k-th found.
+static size_t ordering_grid_nearest(const OrderingGrid* grid, const float* point, size_t skip,
+  size_t k, size_t* found, double* distances)
+{
+  const size_t center = ordering_cell_index(grid, point);
+  const long cx = center % grid->nx, cy = center / grid->nx;
+  const long max_ring = grid->nx > grid->ny ? grid->nx : grid->ny;
+  size_t n_found = 0, m;
+  long ring, x, y;
+
+  for (ring = 0; ring <= max_ring; ring++)
+  {
+    if (n_found == k && distances[k-1] <= (ring - 1) * grid->cell)
+      break;
+
+    for (y = cy - ring; y <= cy + ring; y++)
+    {
+      if (y < 0 || y >= (long) grid->ny)
+        continue;
+      // Inner rows only contribute the two cells on the ring
+      const long step = (y == cy - ring || y == cy + ring) ? 1 : 2 * ring;
+      for (x = cx - ring; x <= cx + ring; x += step)
+      {
+        if (x < 0 || x >= (long) grid->nx)
+          continue;
+        const size_t c = y * grid->nx + x;
+        const size_t* items = grid->items + grid->first[c];
+        for (m = 0; m < grid->count[c]; m++)
+        {
+          if (items[m] >> 1 == skip)
+            continue;
+          double distance = ordering_distance(point, ordering_point(grid->strokes, items[m]));
+          if (n_found == k && distance >= distances[k-1])
+            continue;
+
+          // Insertion into the sorted candidates
+          size_t at = n_found < k ? n_found++ : k - 1;
+          while (at > 0 && distances[at-1] > distance)
+          {
+            distances[at] = distances[at-1];
+            found[at] = found[at-1];
+            at--;
+          }
+          distances[at] = distance;
+          found[at] = items[m];
+
+          // Nothing beats k coincident endpoints, which crowd single cells
+          if (n_found == k && distances[k-1] == 0)
+            return n_found;
+        }
+      }
+    }
+  }
+  return n_found;
+}
+
+// Distance between the exit (1) or entry (0) points of two strokes in the tour
+static inline double ordering_gap(const OrderingTour* tour, size_t a, int a_exit, size_t b, int b_exit)
+{
+  if (a == tour->n || b == tour->n)
+    return 0;
+  return ordering_distance(
+    ordering_point(tour->strokes, 2*a + (a_exit ^ tour->flip[a])),
+    ordering_point(tour->strokes, 2*b + (b_exit ^ tour->flip[b])));
+}
+
+// Reverses the length positions from \from on, wrapping around, and the
+// direction of their strokes
+static void ordering_reverse(OrderingTour* tour, size_t from, size_t length)
+{
+  const size_t n_nodes = tour->n + 1;
+  size_t k;
+
+  for (k = 0; k < length / 2; k++)
+  {
+    const size_t p = (from + k) % n_nodes, q = (from + length - 1 - k) % n_nodes;
+    const size_t a = tour->tour[p];
+    tour->tour[p] = tour->tour[q];
+    tour->tour[q] = a;
+    tour->pos[tour->tour[p]] = p;
+    tour->pos[tour->tour[q]] = q;
+  }
+  for (k = 0; k < length; k++)
+    tour->flip[tour->tour[(from + k) % n_nodes]] ^= 1;
+}
+
+// Replaces the links after positions i and j by links between their
+// strokes and between their successors, reversing everything in between.
+// Returns 1 and applies the move if it shortens the tour.
+static int ordering_two_opt(OrderingTour* tour, size_t i, size_t j, size_t* touched)
+{
+  const size_t n_nodes = tour->n + 1;
+  i %= n_nodes;
+  j %= n_nodes;
+  if (i == j)
+    return 0;
+
+  const size_t a = tour->tour[i], b = tour->tour[(i+1) % n_nodes];
+  const size_t c = tour->tour[j], d = tour->tour[(j+1) % n_nodes];
+  const double gain = ordering_gap(tour, a, 1, b, 0) + ordering_gap(tour, c, 1, d, 0)
+    - ordering_gap(tour, a, 1, c, 1) - ordering_gap(tour, b, 0, d, 0);
+  if (gain <= ORDERING_MIN_GAIN)
+    return 0;
+
+  // Reversing the complement gives the same cycle, walk the shorter side.
+  // Very long reversals are skipped, they would make large jobs quadratic.
+  const size_t length = (j + n_nodes - i) % n_nodes;
+  if ((2 * length <= n_nodes ? length : n_nodes - length) > ORDERING_MAX_REVERSAL)
+    return 0;
+  if (2 * length <= n_nodes)
+    ordering_reverse(tour, i + 1, length);
+  else
+    ordering_reverse(tour, j + 1, n_nodes - length);
+
+  touched[0] = a;
+  touched[1] = b;
+  touched[2] = c;
+  touched[3] = d;
+  return 1;
+}
+
+// Nearest neighbour walk from the start of the first stroke
+static void ordering_seed(OrderingGrid* grid, OrderingTour* tour)
+{
+  const size_t n = tour->n;
+  size_t k, endpoint = 0;
+  double distance;
+
+  tour->tour[0] = n; /* the depot */
+  for (k = 0; k < n; k++)
+  {
+    const size_t s = endpoint >> 1;
+    tour->tour[k+1] = s;
+    tour->pos[s] = k + 1;
+    tour->flip[s] = endpoint & 1;
+    ordering_grid_remove(grid, 2*s);
+    ordering_grid_remove(grid, 2*s + 1);
+
+    if (k + 1 < n)
+      ordering_grid_nearest(grid, ordering_point(tour->strokes, endpoint ^ 1), n, 1, &endpoint, &distance);
+  }
+  tour->pos[n] = 0;
+}
+
+int ordering_plan(const OrderingStroke* strokes, size_t n, size_t* order, unsigned char* reversed)
+{
+  OrderingGrid grid;
+  OrderingTour tour;
+  size_t k;
+
+  if (n == 0)
+    return 0;
+  if (ordering_grid_new(strokes, n, &grid) == -1)
+    return -1;
+
+  tour.strokes = strokes;
+  tour.n = n;
+  tour.tour = malloc(sizeof(size_t) * (n + 1));
+  tour.pos = malloc(sizeof(size_t) * (n + 1));
+  tour.flip = calloc(n + 1, sizeof(unsigned char));
+  size_t* neighbours = malloc(sizeof(size_t) * 2 * n * ORDERING_NEIGHBOURS);
+  size_t* n_neighbours = malloc(sizeof(size_t) * 2 * n);
+  double* distances = malloc(sizeof(double) * 2 * n * ORDERING_NEIGHBOURS);
+  size_t* queue = malloc(sizeof(size_t) * n);
+  unsigned char* queued = malloc(n);
+  int status = -1;
+
+  if (tour.tour == NULL || tour.pos == NULL || tour.flip == NULL || neighbours == NULL
+    || n_neighbours == NULL || distances == NULL || queue == NULL || queued == NULL)
+    goto done;
+
+  // Candidate endpoints of every endpoint, before the walk empties the grid
+  for (k = 0; k < 2 * n; k++)
+  {
+    n_neighbours[k] = ordering_grid_nearest(&grid, ordering_point(strokes, k), k >> 1,
+      ORDERING_NEIGHBOURS, neighbours + k * ORDERING_NEIGHBOURS, distances + k * ORDERING_NEIGHBOURS);
+  }
+
+  ordering_seed(&grid, &tour);
+
+  // 2-opt with neighbour lists: a move must link an endpoint to one of its
+  // candidates, and only strokes next to a change are looked at again
+  size_t head = 0, tail = 0, n_queued = n, touched[4], m;
+  for (k = 0; k < n; k++)
+  {
+    queue[k] = tour.tour[k+1];
+    queued[queue[k]] = 1;
+  }
+
+  while (n_queued > 0)
+  {
+    const size_t a = queue[head];
+    head = (head + 1) % n;
+    n_queued--;
+    queued[a] = 0;
+
+    int improved = 0;
+    size_t side;
+    for (side = 0; side < 2 && !improved; side++)
+    {
+      // side 0 links the exit of a anew, side 1 its entry
+      const size_t endpoint = 2*a + ((side == 0) ^ tour.flip[a]);
+      const size_t i = tour.pos[a];
+      const double current = side == 0
+        ? ordering_gap(&tour, a, 1, tour.tour[(i + 1) % (n + 1)], 0)
+        : ordering_gap(&tour, tour.tour[(i + n) % (n + 1)], 1, a, 0);
+
+      for (m = 0; m < n_neighbours[endpoint] && !improved; m++)
+      {
+        const size_t candidate = neighbours[endpoint * ORDERING_NEIGHBOURS + m];
+        const size_t c = candidate >> 1;
+        if (distances[endpoint * ORDERING_NEIGHBOURS + m] >= current)
+          break;
+        if (side == 0 && (candidate & 1) == (size_t) (1 ^ tour.flip[c]))
+          improved = ordering_two_opt(&tour, i, tour.pos[c], touched);
+        else if (side == 1 && (candidate & 1) == tour.flip[c])
+          improved = ordering_two_opt(&tour, tour.pos[c] + n, i + n, touched);
+      }
+    }
+
+    if (improved)
+    {
+      for (m = 0; m < 4; m++)
+      {
+        if (touched[m] < n && !queued[touched[m]])
+        {
+          queue[tail] = touched[m];
+          tail = (tail + 1) % n;
+          queued[touched[m]] = 1;
+          n_queued++;
+        }
+      }
+    }
+  }
+
+  // Cut the cycle at the depot
+  const size_t depot = tour.pos[n];
+  for (k = 0; k < n; k++)
+  {
+    order[k] = tour.tour[(depot + 1 + k) % (n + 1)];
+    reversed[order[k]] = tour.flip[order[k]];
+  }
+  status = 0;
+
+done:
+  ordering_grid_free(&grid);
+  free(tour.tour);
+  free(tour.pos);
+  free(tour.flip);
+  free(neighbours);
+  free(n_neighbours);
+  free(distances);
+  free(queue);
+  free(queued);
+  return status;
+}
+
+static inline size_t ordering_hash_slot(const OrderingHash* hash, long long x, long long y)
+{
+  uint64_t h = (uint64_t) x * 0x9E3779B97F4A7C15ull ^ (uint64_t) y * 0xC2B2AE3D27D4EB4Full;
+  return (h ^ h >> 29) & hash->mask;
+}
+
+// Returns the bucket of the quantized position, adding it if \add is set,
+// or SIZE_MAX if there is none
+static size_t ordering_hash_bucket(OrderingHash* hash, long long x, long long y, size_t* n_buckets, int add)
+{
+  size_t i = ordering_hash_slot(hash, x, y);
+  while (hash->table[i] != SIZE_MAX)
+  {
+    const size_t b = hash->table[i];
+    if (hash->keys[2*b] == x && hash->keys[2*b + 1] == y)
+      return b;
+    i = (i + 1) & hash->mask;
+  }
+  if (!add)
+    return SIZE_MAX;
+  hash->keys[2 * *n_buckets] = x;
+  hash->keys[2 * *n_buckets + 1] = y;
+  hash->table[i] = *n_buckets;
+  return (*n_buckets)++;
+}
+
+static void ordering_hash_free(OrderingHash* hash)
+{
+  free(hash->table);
+  free(hash->keys);
+  free(hash->first);
+  free(hash->count);
+  free(hash->items);
+  free(hash->slot);
+  free(hash->bucket);
+}
+
+static int ordering_hash_new(const OrderingStroke* strokes, size_t n, float tolerance, OrderingHash* hash)
+{
+  const size_t n_points = 2 * n;
+  size_t size = 16, n_buckets = 0, e, b;
+
+  // At most half full
+  while (size < 2 * n_points)
+    size *= 2;
+  hash->strokes = strokes;
+  hash->tolerance = tolerance;
+  hash->mask = size - 1;
+  hash->table = malloc(sizeof(size_t) * size);
+  hash->keys = malloc(sizeof(long long) * 2 * n_points);
+  hash->first = malloc(sizeof(size_t) * (n_points + 1));
+  hash->count = calloc(n_points, sizeof(size_t));
+  hash->items = malloc(sizeof(size_t) * n_points);
+  hash->slot = malloc(sizeof(size_t) * n_points);
+  hash->bucket = malloc(sizeof(size_t) * n_points);
+  if (hash->table == NULL || hash->keys == NULL || hash->first == NULL || hash->count == NULL
+    || hash->items == NULL || hash->slot == NULL || hash->bucket == NULL)
+  {
+    ordering_hash_free(hash);
+    return -1;
+  }
+  for (e = 0; e < size; e++)
+    hash->table[e] = SIZE_MAX;
+
+  // Counting sort of the endpoints by bucket
+  for (e = 0; e < n_points; e++)
+  {
+    const float* point = ordering_point(strokes, e);
+    b = ordering_hash_bucket(hash, floor(point[0] / tolerance), floor(point[1] / tolerance), &n_buckets, 1);
+    hash->bucket[e] = b;
+    hash->count[b]++;
+  }
+  hash->first[0] = 0;
+  for (b = 0; b < n_buckets; b++)
+  {
+    hash->first[b+1] = hash->first[b] + hash->count[b];
+    hash->count[b] = 0;
+  }
+  for (e = 0; e < n_points; e++)
+  {
+    b = hash->bucket[e];
+    hash->slot[e] = hash->count[b];
+    hash->items[hash->first[b] + hash->count[b]++] = e;
+  }
+  return 0;
+}
+
+// Finds an endpoint within the tolerance of \point in its bucket or the
+// eight around it
+static int ordering_hash_find(OrderingHash* hash, const float* point, size_t* endpoint)
+{
+  const long long qx = floor(point[0] / hash->tolerance), qy = floor(point[1] / hash->tolerance);
+  long long dx, dy;
+  size_t m;
+
+  for (dy = -1; dy <= 1; dy++)
+  {
+    for (dx = -1; dx <= 1; dx++)
+    {
+      const size_t b = ordering_hash_bucket(hash, qx + dx, qy + dy, NULL, 0);
+      if (b == SIZE_MAX)
+        continue;
+      const size_t* items = hash->items + hash->first[b];
+      for (m = 0; m < hash->count[b]; m++)
+      {
+        if (ordering_distance(point, ordering_point(hash->strokes, items[m])) <= hash->tolerance)
+        {
+          *endpoint = items[m];
+          return 1;
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+// Takes both endpoints of stroke \s out of the hash
+static void ordering_hash_remove(OrderingHash* hash, size_t s)
+{
+  size_t w;
+  for (w = 0; w < 2; w++)
+  {
+    const size_t b = hash->bucket[2*s + w];
+    ordering_remove(hash->items + hash->first[b], &hash->count[b], hash->slot, 2*s + w);
+  }
+}
+
+size_t ordering_chain(const OrderingStroke* strokes, size_t n, float tolerance, size_t* order,
+  unsigned char* reversed, unsigned char* joined)
+{
+  OrderingHash hash;
+  size_t k, n_out = 0, n_chains = 0, endpoint;
+
+  if (n == 0)
+    return 0;
+  if (ordering_hash_new(strokes, n, tolerance, &hash) == -1)
+    return (size_t) -1;
+
+  size_t* chained = malloc(sizeof(size_t) * n);
+  size_t* back = malloc(sizeof(size_t) * n);
+  unsigned char* placed = calloc(n, 1);
+  if (chained == NULL || back == NULL || placed == NULL)
+  {
+    n_chains = (size_t) -1;
+    goto done;
+  }
+
+  for (k = 0; k < n; k++)
+  {
+    const size_t s = order[k];
+    size_t n_back = 0, b;
+    if (placed[s])
+      continue;
+    placed[s] = 1;
+    ordering_hash_remove(&hash, s);
+
+    // Walk back from the entry of s to the head of its chain, every stroke
+    // found leaves where the one after it enters
+    endpoint = 2*s + reversed[s];
+    while (ordering_hash_find(&hash, ordering_point(strokes, endpoint), &endpoint))
+    {
+      const size_t t = endpoint >> 1;
+      placed[t] = 1;
+      ordering_hash_remove(&hash, t);
+      reversed[t] = 1 ^ (endpoint & 1);
+      back[n_back++] = t;
+      endpoint ^= 1;
+    }
+    for (b = n_back; b > 0; b--)
+    {
+      chained[n_out] = back[b-1];
+      joined[n_out++] = b < n_back;
+    }
+    chained[n_out] = s;
+    joined[n_out++] = n_back > 0;
+
+    // Then forward from its exit, every stroke found enters where the one
+    // before it leaves
+    endpoint = 2*s + (1 ^ reversed[s]);
+    while (ordering_hash_find(&hash, ordering_point(strokes, endpoint), &endpoint))
+    {
+      const size_t t = endpoint >> 1;
+      placed[t] = 1;
+      ordering_hash_remove(&hash, t);
+      reversed[t] = endpoint & 1;
+      chained[n_out] = t;
+      joined[n_out++] = 1;
+      endpoint ^= 1;
+    }
+    n_chains++;
+  }
+
+  for (k = 0; k < n; k++)
+    order[k] = chained[k];
+
+done:
+  ordering_hash_free(&hash);
+  free(chained);
+  free(back);
+  free(placed);
+  return n_chains;
+}
+
+size_t ordering_gaps(const OrderingStroke* strokes, size_t n, const size_t* order, const unsigned char* reversed,
+  double distance)
+{
+  size_t gaps = 0, k;
+
+  for (k = 0; k + 1 < n; k++)
+  {
+    const size_t a = order != NULL ? order[k] : k, b = order != NULL ? order[k+1] : k + 1;
+    const float* exit = reversed != NULL && reversed[a] ? strokes[a].start : strokes[a].end;
+    const float* entry = reversed != NULL && reversed[b] ? strokes[b].end : strokes[b].start;
+    gaps += ordering_distance(exit, entry) > distance;
+  }
+  return gaps;
+}
+
+double ordering_travel(const OrderingStroke* strokes, size_t n, const size_t* order, const unsigned char* reversed)
+{
+  double travel = 0;
+  size_t k;
+
+  for (k = 0; k + 1 < n; k++)
+  {
+    const size_t a = order != NULL ? order[k] : k, b = order != NULL ? order[k+1] : k + 1;
+    const float* exit = reversed != NULL && reversed[a] ? strokes[a].start : strokes[a].end;
+    const float* entry = reversed != NULL && reversed[b] ? strokes[b].end : strokes[b].start;
+    travel += ordering_distance(exit, entry);
+  }
+  return travel;
+}
+
+tsError ordering_reverse_spline(const tsBSpline* spline, tsBSpline* reversed)
+{
+  const size_t dim = spline->dim;
+  size_t i, d;
+
+  tsError err = ts_bspline_copy(spline, reversed);
+  if (err < 0)
+    return err;
+
+  for (i = 0; i < spline->n_ctrlp; i++)
+  {
+    for (d = 0; d < dim; d++)
+      reversed->ctrlp[i*dim + d] = spline->ctrlp[(spline->n_ctrlp - 1 - i)*dim + d];
+  }
+
+  // u runs backwards: u' = min + max - u
+  const tsRational min = spline->knots[0], max = spline->knots[spline->n_knots - 1];
+  for (i = 0; i < spline->n_knots; i++)
+    reversed->knots[i] = min + max - spline->knots[spline->n_knots - 1 - i];
+  return TS_SUCCESS;
+}
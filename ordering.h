@@ -0,0 +1,78 @@
+#ifndef ORDERING_H
+#define ORDERING_H
+
+#include <stddef.h>
+
+#include "tinyspline.h"
+
+#define ORDERING_NEIGHBOURS 8 /* candidate endpoints considered by 2-opt */
+
+/**
+ * The end points of a stroke, the pen lands on one of them and leaves from
+ * the other.
+ */
+typedef struct
+{
+  float start[2];
+  float end[2];
+} OrderingStroke;
+
+/**
+ * Computes a drawing order of \n strokes that keeps the pen-up travel between
+ * them short. Strokes may be drawn from end to start. A nearest neighbour
+ * walk over a grid of the end points seeds the order, which 2-opt moves
+ * between nearby end points improve until none shortens it any further.
+ *
+ * \order receives the stroke indices in drawing order and \reversed (indexed
+ * by stroke) 1 for strokes to draw from end to start. The walk starts at the
+ * first stroke of the file, the improved order wherever it is shortest.
+ *
+ * @return 0    on success.
+ * @return -1   if allocating the index failed (errno is set).
+ */
+int ordering_plan(const OrderingStroke* strokes, size_t n, size_t* order, unsigned char* reversed);
+
+/**
+ * Regroups \n strokes into chains of strokes whose end points coincide within
+ * \tolerance, drawing every chain as one continuous path. Strokes may be
+ * reversed to continue a chain. End points are hashed by their quantized
+ * position, so every stroke is looked up a constant number of times.
+ *
+ * \order holds the drawing order and \reversed the direction of every stroke
+ * on entry, both are updated. Chains are drawn in the order of their first
+ * stroke in \order, which keeps its direction. \joined
+ * (indexed by position) receives 1 for strokes that continue the previous
+ * one.
+ *
+ * @return the number of chains.
+ * @return (size_t) -1 if allocating the hash table failed (errno is set).
+ */
+size_t ordering_chain(const OrderingStroke* strokes, size_t n, float tolerance, size_t* order,
+  unsigned char* reversed, unsigned char* joined);
+
+/**
+ * Returns the number of moves from the end of a stroke to the start of the
+ * next one that are longer than \distance, with \order and \reversed as for
+ * ::ordering_travel.
+ */
+size_t ordering_gaps(const OrderingStroke* strokes, size_t n, const size_t* order, const unsigned char* reversed,
+  double distance);
+
+/**
+ * Returns the length of the straight moves from the end of every stroke to
+ * the start of the next one when drawing \strokes in \order, or in file order
+ * if \order is NULL. \reversed is as for ::ordering_plan, NULL draws every
+ * stroke in its own direction.
+ */
+double ordering_travel(const OrderingStroke* strokes, size_t n, const size_t* order, const unsigned char* reversed);
+
+/**
+ * Sets up \reversed as a copy of \spline that runs from its end to its start:
+ * the control points in reverse order over the mirrored knot vector.
+ *
+ * @return TS_SUCCESS           on success.
+ * @return TS_MALLOC            if allocating memory failed.
+ */
+tsError ordering_reverse_spline(const tsBSpline* spline, tsBSpline* reversed);
+
+#endif // ORDERING_H
@@ -30,6 +30,32 @@ const char *form_update_os_payload(int frame_number, CPFrameVersion02 *frame)
   return json_object_to_json_string(jobj);
 }
 
+const char *form_update_os_payload_v03(int frame_number, CPFrameVersion03 *frame)
+{
+  /*Creating a json object*/
+  json_object * jobj = json_object_new_object();
+
+  /*Creating a json integer, the arm joints as in version 2*/
+  json_object *jfrm = json_object_new_int(frame_number);
+  json_object *jtheta1 = json_object_new_int(frame->THETA2);
+  json_object *jtheta2 = json_object_new_int(frame->THETA1);
+  json_object *jtheta3 = json_object_new_int(frame->THETA3);
+  json_object *jtheta4 = json_object_new_int(frame->THETA4);
+  json_object *jd5 = json_object_new_int(frame->D5);
+
+  /*Form the json object*/
+  /*Each of these is like a key value pair*/
+  json_object_object_add(jobj,"frame", jfrm);
+  json_object_object_add(jobj,"theta1", jtheta1);
+  json_object_object_add(jobj,"theta2", jtheta2);
+  json_object_object_add(jobj,"theta3", jtheta3);
+  json_object_object_add(jobj,"theta4", jtheta4);
+  json_object_object_add(jobj,"d5", jd5);
+
+  /*Now printing the json object*/
+  return json_object_to_json_string(jobj);
+}
+
 const char *form_message_payload(const char *title, const char *type, const char *footnote)
 {
   /*Creating a json object*/
@@ -8,6 +8,7 @@
 #define TOULOUSE_AMPQ_STATE_ROUTING_KEY "toulouse.state"
 
 const char *form_update_os_payload(int frame_number, CPFrameVersion02 *frame);
+const char *form_update_os_payload_v03(int frame_number, CPFrameVersion03 *frame);
 const char *form_message_payload(const char *title, const char *type, const char *footnote);
 void die_on_amqp_error(amqp_rpc_reply_t x, char const *context);
 int open_amqp_conn(amqp_connection_state_t *connection);
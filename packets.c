@@ -0,0 +1,173 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "packets.h"
+
+static int packets_write(int fd, const void* data, size_t size)
+{
+  const char* bytes = data;
+  while (size > 0)
+  {
+    ssize_t n = write(fd, bytes, size);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    bytes += n;
+    size -= n;
+  }
+  return 0;
+}
+
+// Extends the file to \frames frames with allocated blocks, or just its size
+// where the file system cannot allocate ahead
+static int packets_extend(PacketWriter* writer, size_t frames)
+{
+  const off_t size = frames * writer->frame_size;
+  int err = posix_fallocate(writer->fd, 0, size);
+  if (err == 0)
+    return 0;
+  if (err != EINVAL && err != EOPNOTSUPP)
+  {
+    errno = err;
+    return -1;
+  }
+  return ftruncate(writer->fd, size);
+}
+
+// Maps the file for \frames frames, replacing the previous mapping
+static int packets_map(PacketWriter* writer, size_t frames)
+{
+  if (writer->map != NULL)
+  {
+    munmap(writer->map, writer->reserved * writer->frame_size);
+    writer->map = NULL;
+  }
+  if (packets_extend(writer, frames) == -1)
+    return -1;
+
+  void* map = mmap(NULL, frames * writer->frame_size, PROT_READ | PROT_WRITE, MAP_SHARED, writer->fd, 0);
+  if (map == MAP_FAILED)
+    return -1;
+  writer->map = map;
+  writer->reserved = frames;
+  return 0;
+}
+
+int packets_open(PacketWriter* writer, const char* path, PacketsMode mode, size_t frame_size, size_t expected)
+{
+  struct stat st;
+
+  memset(writer, 0, sizeof(PacketWriter));
+  writer->frame_size = frame_size;
+  if (strcmp(path, "-") == 0)
+  {
+    writer->fd = STDOUT_FILENO;
+  }
+  else
+  {
+    // Read access is needed for the mapping
+    writer->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (writer->fd == -1)
+      return -1;
+    writer->owned = 1;
+  }
+
+  // The standard output is only streamed to, it may be redirected to the
+  // middle of a file opened for appending
+  writer->regular = writer->owned && fstat(writer->fd, &st) == 0 && S_ISREG(st.st_mode);
+  writer->mode = writer->regular ? mode : PACKETS_BUFFERED;
+
+  if (writer->mode == PACKETS_MMAP)
+  {
+    if (packets_map(writer, expected > PACKETS_BLOCK_FRAMES ? expected : PACKETS_BLOCK_FRAMES) == 0)
+      return 0;
+  }
+  else
+  {
+    if (writer->regular && expected > 0 && packets_extend(writer, expected) == 0)
+      writer->reserved = expected;
+    if (posix_memalign((void**) &writer->block, PACKETS_PAGE, frame_size * PACKETS_BLOCK_FRAMES) == 0)
+      return 0;
+    errno = ENOMEM;
+  }
+
+  int err = errno;
+  if (writer->owned)
+    close(writer->fd);
+  errno = err;
+  return -1;
+}
+
+void* packets_commit(PacketWriter* writer, size_t used, size_t* capacity)
+{
+  if (writer->mode == PACKETS_MMAP)
+  {
+    // Frames were stored in place, grow the mapping once it is full
+    writer->committed += used;
+    if (writer->committed == writer->reserved && packets_map(writer, writer->reserved * 2) == -1)
+      return NULL;
+    *capacity = writer->reserved - writer->committed;
+    return writer->map + writer->committed * writer->frame_size;
+  }
+
+  if (used > 0)
+  {
+    // Preallocate well ahead, so the file is extended rarely and in large
+    // contiguous pieces
+    if (writer->regular && writer->committed + used > writer->reserved)
+    {
+      size_t frames = writer->reserved * 2;
+      if (frames < writer->committed + used + PACKETS_BLOCK_FRAMES)
+        frames = writer->committed + used + PACKETS_BLOCK_FRAMES;
+      if (packets_extend(writer, frames) == -1)
+        return NULL;
+      writer->reserved = frames;
+    }
+    if (packets_write(writer->fd, writer->block, used * writer->frame_size) == -1)
+      return NULL;
+    writer->committed += used;
+  }
+  *capacity = PACKETS_BLOCK_FRAMES;
+  return writer->block;
+}
+
+int packets_close(PacketWriter* writer, size_t used)
+{
+  size_t capacity;
+  int status = 0;
+
+  if (writer->mode == PACKETS_MMAP)
+  {
+    writer->committed += used;
+    munmap(writer->map, writer->reserved * writer->frame_size);
+  }
+  else if (used > 0 && packets_commit(writer, used, &capacity) == NULL)
+  {
+    status = -1;
+  }
+
+  // Drop what was preallocated but never filled
+  if (status == 0 && writer->regular && writer->reserved > 0
+    && ftruncate(writer->fd, writer->committed * writer->frame_size) == -1)
+    status = -1;
+
+  int err = errno;
+  free(writer->block);
+  if (writer->owned && close(writer->fd) == -1 && status == 0)
+  {
+    err = errno;
+    status = -1;
+  }
+  memset(writer, 0, sizeof(PacketWriter));
+  writer->fd = -1;
+  errno = err;
+  return status;
+}
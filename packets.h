@@ -0,0 +1,70 @@
+#ifndef PACKETS_H
+#define PACKETS_H
+
+#include <stddef.h>
+
+#include "CPFrames.h"
+
+#define PACKETS_PAGE 4096
+#define PACKETS_BLOCK_FRAMES 16384 /* 48 pages of version 2 frames, 60 of version 3 */
+
+typedef enum
+{
+  PACKETS_BUFFERED = 0, /* frames are staged in an aligned block and written at once */
+  PACKETS_MMAP          /* frames are stored straight into a shared mapping of the file */
+} PacketsMode;
+
+/**
+ * Output stage of the planner. Frames are filled into blocks handed out by
+ * ::packets_commit, so the file sees one write(2) per block in buffered mode
+ * and no system call at all while a block of the mapping is filled in mmap
+ * mode. Regular files are preallocated ahead of the frames and truncated to
+ * the frames actually committed when closing.
+ */
+typedef struct
+{
+  int fd;
+  int owned;                /* fd was opened by ::packets_open */
+  int regular;              /* fd is a regular file, can be preallocated and truncated */
+  PacketsMode mode;
+  size_t frame_size;        /* bytes per frame, CPV02_SIZE or CPV03_SIZE */
+  unsigned char* block;     /* page aligned staging block of buffered mode */
+  unsigned char* map;       /* mapping of mmap mode */
+  size_t committed;         /* frames handed to the file */
+  size_t reserved;          /* frames the file is preallocated or mapped for */
+} PacketWriter;
+
+/**
+ * Creates (or truncates) the packets file \path for \writer, "-" streams to
+ * the standard output. Every frame takes \frame_size bytes. \expected is
+ * the number of frames the job will likely produce, 0 if unknown: the file
+ * is preallocated and, in mmap mode, mapped for that many frames up front.
+ * Outputs that cannot be mapped, like pipes and the standard output, use
+ * buffered mode whatever \mode asks for.
+ *
+ * @return 0    on success.
+ * @return -1   if the file could not be opened, allocated or mapped (errno
+ *              is set).
+ */
+int packets_open(PacketWriter* writer, const char* path, PacketsMode mode, size_t frame_size, size_t expected);
+
+/**
+ * Hands the first \used frames of the block last returned to the file and
+ * returns the next block to fill, whose length in frames is stored in
+ * \capacity. The first call passes 0 for \used.
+ *
+ * @return the next block, NULL if writing, preallocating or mapping the file
+ *         failed (errno is set).
+ */
+void* packets_commit(PacketWriter* writer, size_t used, size_t* capacity);
+
+/**
+ * Commits the last \used frames, trims the file to the committed frames and
+ * releases all resources of \writer.
+ *
+ * @return 0    on success.
+ * @return -1   if writing or truncating the file failed (errno is set).
+ */
+int packets_close(PacketWriter* writer, size_t used);
+
+#endif // PACKETS_H
@@ -0,0 +1,188 @@
+#include <math.h>
+
+#include "profile.h"
+
+#define PROFILE_ITERATIONS 24 /* bisection steps for the peak speed, far below a millisecond */
+
+// Time to change the speed by dv with a ramp that is limited by jerk, then
+// by acceleration
+static double profile_ramp_time(double dv, double acceleration, double jerk)
+{
+  if (dv <= 0)
+    return 0;
+  if (dv >= acceleration * acceleration / jerk)
+    return dv / acceleration + acceleration / jerk;
+  return 2 * sqrt(dv / jerk);
+}
+
+// Distance covered while changing the speed from v0 to v1, the ramp is
+// symmetric so the mean speed applies
+static double profile_ramp_distance(double v0, double v1, double acceleration, double jerk)
+{
+  return (v0 + v1) * 0.5 * profile_ramp_time(fabs(v1 - v0), acceleration, jerk);
+}
+
+// Highest speed reachable from v0 within length
+static double profile_reach(double v0, double length, double acceleration, double jerk)
+{
+  const double knee = acceleration * acceleration / jerk;
+
+  // Long enough to reach full acceleration: solve the quadratic
+  // (v1^2 - v0^2) / 2a + (v0 + v1) a / 2j = length
+  double c = v0 * knee - v0 * v0 - 2 * acceleration * length;
+  double v1 = (-knee + sqrt(knee * knee - 4 * c)) * 0.5;
+  if (v1 - v0 >= knee)
+    return v1;
+
+  // Otherwise the ramp takes 2s with s = sqrt(dv / j), which solves the
+  // cubic j s^3 + 2 v0 s - length = 0 with a single real root
+  double p = 2 * v0 / jerk, q = -length / jerk;
+  double root = sqrt(q * q * 0.25 + p * p * p / 27);
+  double s = cbrt(-q * 0.5 + root) + cbrt(-q * 0.5 - root);
+  return v0 + jerk * s * s;
+}
+
+// Duration of a move of length from v0 to v1, as fast as the limits allow
+static double profile_move_time(double v0, double v1, double length, double velocity, double acceleration,
+  double jerk)
+{
+  double low = v0 > v1 ? v0 : v1, high = velocity, peak;
+
+  if (length <= 0)
+    return 0;
+
+  if (profile_ramp_distance(v0, high, acceleration, jerk) + profile_ramp_distance(high, v1, acceleration, jerk) <= length)
+  {
+    peak = high;
+  }
+  else
+  {
+    for (int k = 0; k < PROFILE_ITERATIONS; k++)
+    {
+      const double middle = (low + high) * 0.5;
+      if (profile_ramp_distance(v0, middle, acceleration, jerk) + profile_ramp_distance(middle, v1, acceleration, jerk) <= length)
+        low = middle;
+      else
+        high = middle;
+    }
+    peak = low;
+  }
+  if (peak <= 0)
+    return 0;
+
+  double ramps = profile_ramp_distance(v0, peak, acceleration, jerk) + profile_ramp_distance(peak, v1, acceleration, jerk);
+  double cruise = length > ramps ? (length - ramps) / peak : 0;
+  return profile_ramp_time(peak - v0, acceleration, jerk) + profile_ramp_time(peak - v1, acceleration, jerk) + cruise;
+}
+
+int profile_plan(const Trajectory* trajectory, size_t first, const ProfileLimits* limits, Arena* arena,
+  double* durations, unsigned char* blended, double* total)
+{
+  const size_t m = trajectory->size - first;
+  size_t j;
+  int k;
+
+  *total = 0;
+  if (m == 0)
+    return 0;
+  durations[first] = 0;
+  if (blended != NULL)
+  {
+    for (j = 0; j < m; j++)
+      blended[first + j] = 0;
+  }
+  if (m == 1)
+    return 0;
+
+  // Per move: length, direction and the limits along it, per frame: speed
+  double* scratch = arena_alloc(arena, sizeof(double) * m * (5 + PROFILE_JOINTS));
+  if (scratch == NULL)
+    return -1;
+  double* length = scratch;
+  double* velocity = scratch + m;
+  double* acceleration = scratch + m * 2;
+  double* jerk = scratch + m * 3;
+  double* speed = scratch + m * 4;
+  double* direction = scratch + m * 5;
+
+  for (j = 1; j < m; j++)
+  {
+    const size_t i = first + j;
+    double delta[PROFILE_JOINTS] = {
+      floor(trajectory->theta1[i]) - floor(trajectory->theta1[i-1]),
+      floor(trajectory->theta2[i]) - floor(trajectory->theta2[i-1]),
+      floor(trajectory->d3[i]) - floor(trajectory->d3[i-1])
+    };
+
+    length[j] = sqrt(delta[0] * delta[0] + delta[1] * delta[1] + delta[2] * delta[2]);
+    velocity[j] = acceleration[j] = jerk[j] = INFINITY;
+    for (k = 0; k < PROFILE_JOINTS; k++)
+    {
+      double share = length[j] > 0 ? fabs(delta[k]) / length[j] : 0;
+      direction[j * PROFILE_JOINTS + k] = length[j] > 0 ? delta[k] / length[j] : 0;
+      if (share == 0)
+        continue;
+      velocity[j] = fmin(velocity[j], limits->velocity[k] / share);
+      acceleration[j] = fmin(acceleration[j], limits->acceleration[k] / share);
+      jerk[j] = fmin(jerk[j], limits->jerk[k] / share);
+    }
+  }
+
+  // Speed through every frame: what both moves and the turn allow
+  speed[0] = speed[m-1] = 0;
+  for (j = 1; j + 1 < m; j++)
+  {
+    if (length[j] == 0 || length[j+1] == 0)
+    {
+      speed[j] = 0;
+      continue;
+    }
+    speed[j] = fmin(velocity[j], velocity[j+1]);
+
+    double turn[PROFILE_JOINTS], angle = 0;
+    for (k = 0; k < PROFILE_JOINTS; k++)
+    {
+      turn[k] = fabs(direction[(j+1) * PROFILE_JOINTS + k] - direction[j * PROFILE_JOINTS + k]);
+      angle += turn[k] * turn[k];
+    }
+    angle = sqrt(angle);
+
+    if (limits->deviation > 0)
+    {
+      // The blend from b before the frame to b after it, a quadratic Bezier
+      // with the frame as its middle control point, is closest to the frame
+      // b |u2 - u1| / 4 away. The joints turn over the time 2b / v.
+      double b = fmin(length[j], length[j+1]) * 0.5;
+      if (angle > 0)
+        b = fmin(b, 4 * limits->deviation / angle);
+      for (k = 0; k < PROFILE_JOINTS; k++)
+      {
+        if (turn[k] > 0)
+          speed[j] = fmin(speed[j], sqrt(2 * b * limits->acceleration[k] / turn[k]));
+      }
+      if (blended != NULL)
+        blended[first + j] = 1;
+      continue;
+    }
+
+    for (k = 0; k < PROFILE_JOINTS; k++)
+    {
+      if (turn[k] > 0)
+        speed[j] = fmin(speed[j], limits->acceleration[k] * limits->junction_time / turn[k]);
+    }
+  }
+
+  // Look ahead to the end of the stroke, then back to its start, so every
+  // speed can be braked from and accelerated to
+  for (j = m - 1; j-- > 1; )
+    speed[j] = fmin(speed[j], profile_reach(speed[j+1], length[j+1], acceleration[j+1], jerk[j+1]));
+  for (j = 1; j + 1 < m; j++)
+    speed[j] = fmin(speed[j], profile_reach(speed[j-1], length[j], acceleration[j], jerk[j]));
+
+  for (j = 1; j < m; j++)
+  {
+    durations[first + j] = profile_move_time(speed[j-1], speed[j], length[j], velocity[j], acceleration[j], jerk[j]);
+    *total += durations[first + j];
+  }
+  return 0;
+}
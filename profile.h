@@ -0,0 +1,52 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stddef.h>
+
+#include "arena.h"
+#include "trajectory.h"
+
+#define PROFILE_JOINTS 3 /* theta1, theta2 and d3 */
+
+/**
+ * What the joints can do, in encoder steps (actuator units for d3) per
+ * second, second squared and second cubed.
+ */
+typedef struct
+{
+  double velocity[PROFILE_JOINTS];
+  double acceleration[PROFILE_JOINTS];
+  double jerk[PROFILE_JOINTS];
+  double junction_time; /* s the controller takes to turn the joints at a frame */
+  double deviation;     /* steps the joints may cut a corner by, 0 to turn at every frame */
+} ProfileLimits;
+
+/**
+ * Computes the time-optimal durations of the moves between the frames in
+ * [\first, size) of \trajectory, which starts and ends at rest. Every move
+ * runs straight in joint space at the integer steps the frames carry, with
+ * an S-curve speed profile whose peak stays within the velocity and whose
+ * ramps stay within the acceleration and jerk of every joint. The speed
+ * through a frame is limited by how sharply the joints turn there, so that
+ * the velocity change fits into \limits->junction_time, and by what the
+ * moves up to the end of the stroke leave room to brake for.
+ *
+ * With a \limits->deviation the interior frames are passed through instead:
+ * the corner is replaced by a parabolic blend that starts and ends on the
+ * adjacent moves, at most half way along them, and keeps within the
+ * deviation of the frame. The speed through the blend is what turning the
+ * joints over its length allows. \blended (NULL if not needed) receives 1
+ * for the frames passed through and 0 for the others.
+ *
+ * \durations[i] receives the seconds the move onto frame i takes,
+ * \durations[\first] is 0 as the move onto the first frame is not part of
+ * the stroke. \total receives the sum.
+ *
+ * @return 0    on success.
+ * @return -1   if the arena could not allocate the scratch space (errno is
+ *              set).
+ */
+int profile_plan(const Trajectory* trajectory, size_t first, const ProfileLimits* limits, Arena* arena,
+  double* durations, unsigned char* blended, double* total);
+
+#endif // PROFILE_H
@@ -0,0 +1,281 @@
+#include <stdlib.h>
+#include <math.h>
+
+#include "sampling.h"
+
+// Fallback for splines that do not fit the fixed size difference tables
+static tsError sampling_de_boor(const tsBSpline* spline, const tsRational step, const size_t n,
+  tsRational* points)
+{
+  tsRational* us = malloc(sizeof(tsRational) * n);
+  tsRational* scratch = malloc(sizeof(tsRational) * spline->order * spline->dim);
+  tsError err = TS_MALLOC;
+  size_t j;
+
+  if (us != NULL && scratch != NULL)
+  {
+    const tsRational u_min = spline->knots[spline->deg];
+    for (j = 0; j < n; j++)
+      us[j] = u_min + j*step;
+    err = ts_bspline_evaluate_many(spline, us, n, scratch, points);
+  }
+
+  free(us);
+  free(scratch);
+  return err;
+}
+
+// Replaces the values in table[0..deg] by their forward differences
+static void sampling_differences(double table[][SAMPLING_MAX_DIM], const size_t deg, const size_t dim)
+{
+  size_t i, k, d;
+  for (i = 1; i <= deg; i++)
+  {
+    for (k = deg; k >= i; k--)
+    {
+      for (d = 0; d < dim; d++)
+        table[k][d] -= table[k-1][d];
+    }
+  }
+}
+
+tsError sampling_span(const tsBSpline* spline, const size_t k, SamplingSpan* span)
+{
+  tsRational scratch[(SAMPLING_MAX_DEGREE+1) * SAMPLING_MAX_DIM];
+  tsRational node[SAMPLING_MAX_DIM];
+  size_t i, d;
+  tsError err;
+
+  span->a = spline->knots[k];
+  span->b = spline->knots[k+1];
+  span->deg = spline->deg;
+  span->dim = spline->dim;
+
+  // Spline continuity makes the values at the span ends the same as inside,
+  // a constant piece is taken from the middle of the span
+  for (i = 0; i <= span->deg; i++)
+  {
+    const double t = span->deg > 0 ? (double) i / span->deg : 0.5;
+    err = ts_bspline_evaluate_point(spline, span->a + (span->b - span->a) * t, scratch, node);
+    if (err < 0)
+      return err;
+    for (d = 0; d < span->dim; d++)
+      span->delta[i][d] = node[d];
+  }
+  sampling_differences(span->delta, span->deg, span->dim);
+  return TS_SUCCESS;
+}
+
+void sampling_span_evaluate(const SamplingSpan* span, const double u, double* point)
+{
+  const double s = (u - span->a) / (span->b - span->a) * span->deg;
+  double factor[SAMPLING_MAX_DEGREE+1];
+  size_t k, d;
+
+  // The nested Newton factors are shared by all coordinates
+  for (k = 1; k <= span->deg; k++)
+    factor[k] = (s - (k-1)) / k;
+  for (d = 0; d < span->dim; d++)
+  {
+    double value = span->delta[span->deg][d];
+    for (k = span->deg; k > 0; k--)
+      value = span->delta[k-1][d] + factor[k] * value;
+    point[d] = value;
+  }
+}
+
+tsError sampling_forward_differences(
+  const tsBSpline* spline, const tsRational step, const size_t n,
+  tsRational* points
+)
+{
+  const size_t deg = spline->deg;
+  const size_t dim = spline->dim;
+
+  // Recovering a span costs deg+1 de Boor evaluations, which only pays off
+  // when the spans hold more samples than that on average
+  if (deg < 1 || deg > SAMPLING_MAX_DEGREE || dim > SAMPLING_MAX_DIM
+    || n < (deg + 1) * (spline->n_ctrlp - deg))
+    return sampling_de_boor(spline, step, n, points);
+  if (n == 0)
+    return TS_SUCCESS;
+
+  const size_t last_span = spline->n_ctrlp - 1; /* spans deg..n_ctrlp-1 form the domain */
+  const double u_min = spline->knots[deg];
+
+  SamplingSpan piece;
+  double differences[SAMPLING_MAX_DEGREE+1][SAMPLING_MAX_DIM];
+  size_t span, j = 0, k, d;
+  tsError err;
+
+  for (span = deg; span <= last_span && j < n; span++)
+  {
+    const double a = spline->knots[span];
+    const double b = spline->knots[span+1];
+    const int last = span == last_span;
+
+    // Skip empty spans and spans that no sample falls into
+    if (b <= a || (!last && u_min + j*(double)step > b))
+      continue;
+
+    err = sampling_span(spline, span, &piece);
+    if (err < 0)
+      return err;
+
+    // Evaluate the first deg+1 samples of the span exactly and turn them
+    // into the forward difference table of the sample grid
+    for (k = 0; k <= deg; k++)
+      sampling_span_evaluate(&piece, u_min + (j + k)*(double)step, differences[k]);
+    sampling_differences(differences, deg, dim);
+
+    // Every sample up to the end of the span is one round of additions,
+    // the last span also takes any sample rounded past u_max
+    while (j < n && (last || u_min + j*(double)step <= b))
+    {
+      for (d = 0; d < dim; d++)
+        points[j*dim + d] = differences[0][d];
+      for (k = 0; k < deg; k++)
+      {
+        for (d = 0; d < dim; d++)
+          differences[k][d] += differences[k+1][d];
+      }
+      j++;
+    }
+  }
+
+  return TS_SUCCESS;
+}
+
+typedef struct
+{
+  const tsBSpline* spline;
+  double tolerance;
+  double max_segment;
+  tsRational* scratch;  /* de Boor scratch */
+  tsRational* levels;   /* quarter points of every subdivision level */
+  tsRational** us;
+  size_t* n;
+  size_t* capacity;
+} SamplingAdaptive;
+
+static tsError sampling_append(SamplingAdaptive* sampling, const tsRational u)
+{
+  if (*sampling->n == *sampling->capacity)
+  {
+    const size_t capacity = *sampling->capacity ? *sampling->capacity * 2 : 256;
+    tsRational* us = realloc(*sampling->us, sizeof(tsRational) * capacity);
+    if (us == NULL)
+      return TS_MALLOC;
+    *sampling->us = us;
+    *sampling->capacity = capacity;
+  }
+  (*sampling->us)[(*sampling->n)++] = u;
+  return TS_SUCCESS;
+}
+
+// Distance of \point from the segment [start, end]
+static double sampling_chord_distance(const tsRational* start, const tsRational* end,
+  const tsRational* point, const size_t dim)
+{
+  double length_squared = 0, t = 0, distance = 0;
+  size_t d;
+
+  for (d = 0; d < dim; d++)
+  {
+    length_squared += (double) (end[d] - start[d]) * (end[d] - start[d]);
+    t += (double) (point[d] - start[d]) * (end[d] - start[d]);
+  }
+  t = length_squared > 0 ? t / length_squared : 0;
+  if (t < 0)
+    t = 0;
+  if (t > 1)
+    t = 1;
+  for (d = 0; d < dim; d++)
+  {
+    const double offset = point[d] - (start[d] + t * (end[d] - start[d]));
+    distance += offset * offset;
+  }
+  return sqrt(distance);
+}
+
+// Samples (u0, u1] given the points at both ends and at the middle. The
+// quarter points of this level become the middles of the two halves.
+static tsError sampling_subdivide(SamplingAdaptive* sampling, const double u0, const double u1,
+  const tsRational* p0, const tsRational* p1, const tsRational* mid, const size_t depth)
+{
+  const size_t dim = sampling->spline->dim;
+  tsRational* q1 = sampling->levels + depth * 2 * dim;
+  tsRational* q3 = q1 + dim;
+  const double um = (u0 + u1) / 2;
+  double chord = 0, deviation;
+  size_t d;
+  tsError err;
+
+  if ((err = ts_bspline_evaluate_point(sampling->spline, (u0 + um) / 2, sampling->scratch, q1)) < 0)
+    return err;
+  if ((err = ts_bspline_evaluate_point(sampling->spline, (um + u1) / 2, sampling->scratch, q3)) < 0)
+    return err;
+
+  for (d = 0; d < dim; d++)
+    chord += (double) (p1[d] - p0[d]) * (p1[d] - p0[d]);
+  chord = sqrt(chord);
+  deviation = fmax(sampling_chord_distance(p0, p1, mid, dim),
+    fmax(sampling_chord_distance(p0, p1, q1, dim), sampling_chord_distance(p0, p1, q3, dim)));
+
+  if (depth + 1 < SAMPLING_MAX_SUBDIVISIONS
+    && (deviation > sampling->tolerance || chord > sampling->max_segment))
+  {
+    if ((err = sampling_subdivide(sampling, u0, um, p0, mid, q1, depth + 1)) < 0)
+      return err;
+    return sampling_subdivide(sampling, um, u1, mid, p1, q3, depth + 1);
+  }
+  return sampling_append(sampling, u1);
+}
+
+tsError sampling_adaptive(
+  const tsBSpline* spline, const double tolerance, const double max_segment,
+  tsRational** us, size_t* n, size_t* capacity
+)
+{
+  const size_t dim = spline->dim;
+  SamplingAdaptive sampling = {spline, tolerance, max_segment, NULL, NULL, us, n, capacity};
+  tsRational *start, *end, *mid;
+  size_t k;
+  tsError err;
+
+  *n = 0;
+  sampling.scratch = malloc(sizeof(tsRational) * dim * (spline->order + 3 + 2 * SAMPLING_MAX_SUBDIVISIONS));
+  if (sampling.scratch == NULL)
+    return TS_MALLOC;
+  start = sampling.scratch + dim * spline->order;
+  end = start + dim;
+  mid = end + dim;
+  sampling.levels = mid + dim;
+
+  err = ts_bspline_evaluate_point(spline, spline->knots[spline->deg], sampling.scratch, start);
+  if (err == TS_SUCCESS)
+    err = sampling_append(&sampling, spline->knots[spline->deg]);
+
+  // Every knot span is a polynomial piece of its own, so knots are kept
+  for (k = spline->deg; k < spline->n_ctrlp && err == TS_SUCCESS; k++)
+  {
+    const double a = spline->knots[k];
+    const double b = spline->knots[k+1];
+    tsRational* swap;
+
+    if (b <= a)
+      continue;
+    if ((err = ts_bspline_evaluate_point(spline, b, sampling.scratch, end)) < 0)
+      break;
+    if ((err = ts_bspline_evaluate_point(spline, (a + b) / 2, sampling.scratch, mid)) < 0)
+      break;
+    err = sampling_subdivide(&sampling, a, b, start, end, mid, 0);
+
+    swap = start;
+    start = end;
+    end = swap;
+  }
+
+  free(sampling.scratch);
+  return err;
+}
@@ -0,0 +1,84 @@
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include <stddef.h>
+
+#include "tinyspline.h"
+
+#define SAMPLING_MAX_DEGREE 7 /* higher degrees fall back to de Boor evaluation */
+#define SAMPLING_MAX_DIM 4
+#define SAMPLING_MAX_SUBDIVISIONS 24 /* maximum bisections of a knot span */
+
+/**
+ * The polynomial piece of a spline on one knot span [a, b], kept in Newton
+ * form over deg+1 equidistant nodes of the span.
+ */
+typedef struct
+{
+  double a, b;    /* the knot span */
+  size_t deg;     /* degree of the piece */
+  size_t dim;     /* dimension of the points */
+  double delta[SAMPLING_MAX_DEGREE+1][SAMPLING_MAX_DIM]; /* forward differences at the nodes */
+} SamplingSpan;
+
+/**
+ * Recovers the polynomial of \spline on its knot span [knots[k], knots[k+1]]
+ * from deg+1 de Boor evaluations. \spline must not exceed SAMPLING_MAX_DEGREE
+ * and SAMPLING_MAX_DIM and the span must not be empty.
+ *
+ * @return TS_SUCCESS           on success.
+ * @return TS_U_UNDEFINED       if \spline is not defined on the span.
+ */
+tsError sampling_span(const tsBSpline* spline, const size_t k, SamplingSpan* span);
+
+/**
+ * Evaluates the polynomial of \span at \u, which may lie outside of the span,
+ * and stores the span->dim coordinates in \point.
+ */
+void sampling_span_evaluate(const SamplingSpan* span, const double u, double* point);
+
+/**
+ * Samples \spline at the \n equidistant knot values u_min + j*\step,
+ * j = 0..n-1, and stores the points contiguously in \points.
+ *
+ * On every knot span the spline is a single polynomial. It is recovered from
+ * deg+1 de Boor evaluations inside the span, the first deg+1 samples of the
+ * span are evaluated exactly and all further samples are generated by forward
+ * differencing, which costs deg additions per coordinate instead of a full
+ * de Boor net. Differences are accumulated in double precision and restarted
+ * at every span, which bounds the drift to the length of one span. Sparse
+ * samplings with fewer than deg+1 samples per span on average are evaluated
+ * with ts_bspline_evaluate_many instead.
+ *
+ * @return TS_SUCCESS           on success.
+ * @return TS_MALLOC            if the fallback for splines exceeding
+ *                              SAMPLING_MAX_DEGREE or SAMPLING_MAX_DIM could
+ *                              not allocate its buffers.
+ * @return TS_U_UNDEFINED       if \spline is not defined on its spans.
+ */
+tsError sampling_forward_differences(
+  const tsBSpline* spline, const tsRational step, const size_t n,
+  tsRational* points
+);
+
+/**
+ * Chooses the knot values of an adaptive sampling of \spline and stores them
+ * in \us, growing it with realloc as needed (\capacity holds its current
+ * length). The sampling starts at u_min, ends at u_max and contains every
+ * knot. Between two samples the curve is bisected in knot space while a
+ * point of the curve at 1/4, 1/2 or 3/4 of the interval lies more than
+ * \tolerance away from the chord, or while the chord is longer than
+ * \max_segment, both in the units of the control points. Straight runs thus
+ * get as few samples as \max_segment allows and tight curves as many as
+ * \tolerance requires.
+ *
+ * @return TS_SUCCESS           on success.
+ * @return TS_MALLOC            if allocating memory failed.
+ * @return TS_U_UNDEFINED       if \spline is not defined on its spans.
+ */
+tsError sampling_adaptive(
+  const tsBSpline* spline, const double tolerance, const double max_segment,
+  tsRational** us, size_t* n, size_t* capacity
+);
+
+#endif // SAMPLING_H
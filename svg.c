@@ -0,0 +1,613 @@
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h> // memchr, memcmp
+#include <math.h> // Required for tan, sin, cos, M_PI
+
+#include "svg.h"
+
+#define SVG_INITIAL_CAPACITY 128
+
+// Elements whose content is never drawn directly
+static const char* svg_hidden_elements[] = {
+  "defs", "clipPath", "mask", "marker", "pattern", "symbol", "style",
+  "script", "title", "desc", "metadata", NULL
+};
+
+static const SvgMatrix svg_identity = {1, 0, 0, 1, 0, 0};
+
+static int svg_is_space(char c)
+{
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static int svg_is_name(char c)
+{
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+    c == '-' || c == '_' || c == ':' || c == '.';
+}
+
+// Returns the product m*n, i.e. n is applied first
+static SvgMatrix svg_multiply(SvgMatrix m, SvgMatrix n)
+{
+  SvgMatrix r;
+  r.a = m.a*n.a + m.c*n.b;
+  r.b = m.b*n.a + m.d*n.b;
+  r.c = m.a*n.c + m.c*n.d;
+  r.d = m.b*n.c + m.d*n.d;
+  r.e = m.a*n.e + m.c*n.f + m.e;
+  r.f = m.b*n.e + m.d*n.f + m.f;
+  return r;
+}
+
+static const char* svg_find(const char* start, const char* end, const char* needle)
+{
+  size_t len = strlen(needle);
+  while (start < end)
+  {
+    const char* p = memchr(start, needle[0], end - start);
+    if (p == NULL || (size_t)(end - p) < len)
+      return NULL;
+    if (memcmp(p, needle, len) == 0)
+      return p;
+    start = p + 1;
+  }
+  return NULL;
+}
+
+// Compares the element name [name, name_end) against \expected, ignoring any
+// namespace prefix such as "svg:".
+static int svg_name_is(const char* name, const char* name_end, const char* expected)
+{
+  const char* colon = memchr(name, ':', name_end - name);
+  if (colon != NULL)
+    name = colon + 1;
+  size_t len = strlen(expected);
+  return (size_t)(name_end - name) == len && memcmp(name, expected, len) == 0;
+}
+
+// Finds the value of attribute \name inside the start tag [tag, tag_end)
+static int svg_attribute(const char* tag, const char* tag_end, const char* name,
+  const char** value, const char** value_end)
+{
+  size_t len = strlen(name);
+  const char* p = tag;
+
+  // Skip the element name
+  while (p < tag_end && svg_is_name(*p))
+    p++;
+
+  while (p < tag_end)
+  {
+    while (p < tag_end && !svg_is_name(*p))
+      p++;
+    const char* attribute = p;
+    while (p < tag_end && svg_is_name(*p))
+      p++;
+    const char* attribute_end = p;
+
+    while (p < tag_end && svg_is_space(*p))
+      p++;
+    if (p >= tag_end || *p != '=')
+      continue;
+    p++;
+    while (p < tag_end && svg_is_space(*p))
+      p++;
+    if (p >= tag_end || (*p != '"' && *p != '\''))
+      return 0;
+
+    const char* quote = memchr(p + 1, *p, tag_end - p - 1);
+    if (quote == NULL)
+      return 0;
+
+    if ((size_t)(attribute_end - attribute) == len && memcmp(attribute, name, len) == 0)
+    {
+      *value = p + 1;
+      *value_end = quote;
+      return 1;
+    }
+    p = quote + 1;
+  }
+
+  return 0;
+}
+
+// Skips white space and commas, the separators of path data and transforms
+static const char* svg_skip(const char* p, const char* end)
+{
+  while (p < end && (svg_is_space(*p) || *p == ','))
+    p++;
+  return p;
+}
+
+static int svg_number(const char** cursor, const char* end, double* value)
+{
+  const char* p = svg_skip(*cursor, end);
+  if (p >= end || !((*p >= '0' && *p <= '9') || *p == '-' || *p == '+' || *p == '.'))
+    return 0;
+
+  // Attribute values are always followed by their closing quote, which stops
+  // strtod before it can run past the end of the value.
+  char* number_end;
+  *value = strtod(p, &number_end);
+  if (number_end == p || number_end > end)
+    return 0;
+
+  *cursor = number_end;
+  return 1;
+}
+
+static int svg_parse_transform(const char* p, const char* end, SvgMatrix* transform)
+{
+  *transform = svg_identity;
+
+  for (p = svg_skip(p, end); p < end; p = svg_skip(p, end))
+  {
+    const char* name = p;
+    while (p < end && *p != '(')
+      p++;
+    const char* name_end = p;
+    while (name_end > name && svg_is_space(name_end[-1]))
+      name_end--;
+    if (p >= end)
+      return -1;
+    p++;
+
+    double args[6];
+    int n_args = 0;
+    while (n_args < 6 && svg_number(&p, end, &args[n_args]))
+      n_args++;
+    p = svg_skip(p, end);
+    if (p >= end || *p != ')')
+      return -1;
+    p++;
+
+    SvgMatrix m = svg_identity;
+    if (svg_name_is(name, name_end, "matrix") && n_args == 6)
+    {
+      m.a = args[0]; m.b = args[1]; m.c = args[2];
+      m.d = args[3]; m.e = args[4]; m.f = args[5];
+    }
+    else if (svg_name_is(name, name_end, "translate") && (n_args == 1 || n_args == 2))
+    {
+      m.e = args[0];
+      m.f = n_args == 2 ? args[1] : 0;
+    }
+    else if (svg_name_is(name, name_end, "scale") && (n_args == 1 || n_args == 2))
+    {
+      m.a = args[0];
+      m.d = n_args == 2 ? args[1] : args[0];
+    }
+    else if (svg_name_is(name, name_end, "rotate") && (n_args == 1 || n_args == 3))
+    {
+      double angle = args[0] * M_PI / 180.0;
+      m.a = cos(angle); m.b = sin(angle);
+      m.c = -sin(angle); m.d = cos(angle);
+      if (n_args == 3)
+      {
+        // rotate(a, cx, cy) = translate(cx, cy) rotate(a) translate(-cx, -cy)
+        m.e = args[1] - m.a*args[1] - m.c*args[2];
+        m.f = args[2] - m.b*args[1] - m.d*args[2];
+      }
+    }
+    else if (svg_name_is(name, name_end, "skewX") && n_args == 1)
+    {
+      m.c = tan(args[0] * M_PI / 180.0);
+    }
+    else if (svg_name_is(name, name_end, "skewY") && n_args == 1)
+    {
+      m.b = tan(args[0] * M_PI / 180.0);
+    }
+    else
+    {
+      return -1;
+    }
+
+    *transform = svg_multiply(*transform, m);
+  }
+
+  return 0;
+}
+
+static int svg_push_point(SvgReader* svg, double x, double y,
+  tsRational** values, size_t* capacity, size_t* n_values)
+{
+  if (*n_values + 2 > *capacity)
+  {
+    size_t capacity_new = *capacity ? *capacity * 2 : SVG_INITIAL_CAPACITY;
+    tsRational* values_new = realloc(*values, capacity_new * sizeof(tsRational));
+    if (values_new == NULL)
+      return -1;
+    *values = values_new;
+    *capacity = capacity_new;
+  }
+
+  const SvgMatrix* m = &svg->transform;
+  (*values)[(*n_values)++] = m->a*x + m->c*y + m->e;
+  (*values)[(*n_values)++] = m->b*x + m->d*y + m->f;
+  return 0;
+}
+
+// Appends the cubic Bezier from the current point through the given control
+// points and moves the current point to its end.
+static int svg_push_cubic(SvgReader* svg, double x1, double y1, double x2, double y2,
+  double x3, double y3, tsRational** values, size_t* capacity, size_t* n_values)
+{
+  if (svg_push_point(svg, svg->x, svg->y, values, capacity, n_values) == -1 ||
+      svg_push_point(svg, x1, y1, values, capacity, n_values) == -1 ||
+      svg_push_point(svg, x2, y2, values, capacity, n_values) == -1 ||
+      svg_push_point(svg, x3, y3, values, capacity, n_values) == -1)
+    return -1;
+
+  svg->ctrl_x = x2;
+  svg->ctrl_y = y2;
+  svg->x = x3;
+  svg->y = y3;
+  return 0;
+}
+
+static int svg_push_line(SvgReader* svg, double x, double y,
+  tsRational** values, size_t* capacity, size_t* n_values)
+{
+  double dx = (x - svg->x) / 3.0, dy = (y - svg->y) / 3.0;
+  return svg_push_cubic(svg, svg->x + dx, svg->y + dy, x - dx, y - dy, x, y,
+    values, capacity, n_values);
+}
+
+// Degree elevation of a quadratic Bezier, the reflected control point of T
+// is the quadratic one and not the elevated cubic one.
+static int svg_push_quadratic(SvgReader* svg, double qx, double qy, double x, double y,
+  tsRational** values, size_t* capacity, size_t* n_values)
+{
+  int status = svg_push_cubic(svg,
+    svg->x + 2.0/3.0*(qx - svg->x), svg->y + 2.0/3.0*(qy - svg->y),
+    x + 2.0/3.0*(qx - x), y + 2.0/3.0*(qy - y),
+    x, y, values, capacity, n_values);
+  svg->ctrl_x = qx;
+  svg->ctrl_y = qy;
+  return status;
+}
+
+// Moves to the next drawable element and sets up its path data. Start tags
+// of all other elements only contribute their transform to the stack.
+static int svg_next_element(SvgReader* svg)
+{
+  while (svg->pos < svg->end)
+  {
+    const char* tag = memchr(svg->pos, '<', svg->end - svg->pos);
+    if (tag == NULL)
+    {
+      svg->pos = svg->end;
+      return 0;
+    }
+
+    const char* skip_to = NULL;
+    if (svg->end - tag >= 4 && memcmp(tag, "<!--", 4) == 0)
+      skip_to = "-->";
+    else if (svg->end - tag >= 9 && memcmp(tag, "<![CDATA[", 9) == 0)
+      skip_to = "]]>";
+    else if (svg->end - tag >= 2 && memcmp(tag, "<?", 2) == 0)
+      skip_to = "?>";
+    else if (svg->end - tag >= 2 && memcmp(tag, "<!", 2) == 0)
+      skip_to = ">";
+
+    if (skip_to != NULL)
+    {
+      const char* close = svg_find(tag, svg->end, skip_to);
+      if (close == NULL)
+        return -1;
+      svg->pos = close + strlen(skip_to);
+      continue;
+    }
+
+    // Find the end of the tag, '>' may appear inside of attribute values
+    const char* p = tag + 1;
+    char quote = 0;
+    for (; p < svg->end; p++)
+    {
+      if (quote)
+      {
+        if (*p == quote)
+          quote = 0;
+      }
+      else if (*p == '"' || *p == '\'')
+      {
+        quote = *p;
+      }
+      else if (*p == '>')
+      {
+        break;
+      }
+    }
+    if (p >= svg->end)
+      return -1;
+    const char* tag_end = p;
+    svg->pos = tag_end + 1;
+
+    // End tag, closes the innermost element
+    if (tag[1] == '/')
+    {
+      if (svg->depth == 0)
+        return -1;
+      svg->depth--;
+      continue;
+    }
+
+    const char* name = tag + 1;
+    const char* name_end = name;
+    while (name_end < tag_end && svg_is_name(*name_end))
+      name_end++;
+    int self_closing = tag_end[-1] == '/';
+
+    // Skip everything inside of elements that are not rendered
+    int hidden = 0;
+    size_t i;
+    for (i = 0; svg_hidden_elements[i] != NULL; i++)
+      hidden |= svg_name_is(name, name_end, svg_hidden_elements[i]);
+    if (hidden)
+    {
+      if (!self_closing)
+      {
+        size_t depth = 1;
+        const char* q = svg->pos;
+        while (depth > 0)
+        {
+          q = memchr(q, '<', svg->end - q);
+          if (q == NULL)
+            return -1;
+          const char* q_name = q + (q + 1 < svg->end && q[1] == '/' ? 2 : 1);
+          const char* q_name_end = q_name;
+          while (q_name_end < svg->end && svg_is_name(*q_name_end))
+            q_name_end++;
+          const char* q_end = memchr(q, '>', svg->end - q);
+          if (q_end == NULL)
+            return -1;
+          if (q_name_end - q_name == name_end - name && memcmp(q_name, name, name_end - name) == 0)
+          {
+            if (q[1] == '/')
+              depth--;
+            else if (q_end[-1] != '/')
+              depth++;
+          }
+          q = q_end + 1;
+        }
+        svg->pos = q;
+      }
+      continue;
+    }
+
+    SvgMatrix local = svg_identity;
+    const char* value;
+    const char* value_end;
+    if (svg_attribute(tag, tag_end, "transform", &value, &value_end) &&
+        svg_parse_transform(value, value_end, &local) == -1)
+      return -1;
+
+    SvgMatrix parent = svg->depth > 0 ? svg->stack[svg->depth-1] : svg_identity;
+    SvgMatrix transform = svg_multiply(parent, local);
+
+    if (!self_closing)
+    {
+      if (svg->depth == SVG_MAX_DEPTH)
+        return -1;
+      svg->stack[svg->depth++] = transform;
+    }
+
+    int found = 0;
+    if (svg_name_is(name, name_end, "path") &&
+        svg_attribute(tag, tag_end, "d", &value, &value_end))
+    {
+      found = 1;
+      svg->command = 0;
+      svg->close_at_end = 0;
+    }
+    else if ((svg_name_is(name, name_end, "polyline") || svg_name_is(name, name_end, "polygon")) &&
+        svg_attribute(tag, tag_end, "points", &value, &value_end))
+    {
+      // A point list behaves like path data starting with an implicit M
+      found = 1;
+      svg->command = 'P';
+      svg->close_at_end = svg_name_is(name, name_end, "polygon");
+    }
+
+    if (found)
+    {
+      svg->data = value;
+      svg->data_end = value_end;
+      svg->transform = transform;
+      svg->previous = 0;
+      svg->x = svg->y = 0;
+      svg->start_x = svg->start_y = 0;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+// Parses path data up to the end of the current subpath. Returns 1 if the
+// subpath produced a stroke, 0 if the path data is exhausted.
+static int svg_next_subpath(SvgReader* svg, tsRational** values, size_t* capacity, size_t* n_values)
+{
+  const char* end = svg->data_end;
+
+  for (;;)
+  {
+    const char* p = svg_skip(svg->data, end);
+    svg->data = p;
+
+    if (p >= end)
+    {
+      if (svg->close_at_end && *n_values > 0)
+      {
+        svg->close_at_end = 0;
+        if (svg_push_line(svg, svg->start_x, svg->start_y, values, capacity, n_values) == -1)
+          return -1;
+      }
+      return *n_values > 0;
+    }
+
+    char command;
+    if ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z'))
+    {
+      command = *p;
+      // A new subpath ends the current stroke, it is parsed on the next call
+      if ((command == 'M' || command == 'm') && *n_values > 0)
+        return 1;
+      p++;
+    }
+    else
+    {
+      // Coordinates without a command repeat the previous one, M turns into L.
+      // P marks the first pair of a point list, which moves like M.
+      if (svg->command == 0 || svg->command == 'Z' || svg->command == 'z')
+        return -1;
+      command = svg->command;
+      if (command == 'P')
+        command = 'M';
+      else if (command == 'M')
+        command = 'L';
+      else if (command == 'm')
+        command = 'l';
+    }
+
+    int relative = command >= 'a';
+    double ox = relative ? svg->x : 0, oy = relative ? svg->y : 0;
+    double v[6];
+    int status = 0;
+
+    switch (command)
+    {
+    case 'M': case 'm':
+      if (!svg_number(&p, end, &v[0]) || !svg_number(&p, end, &v[1]))
+        return -1;
+      svg->x = svg->start_x = ox + v[0];
+      svg->y = svg->start_y = oy + v[1];
+      break;
+    case 'L': case 'l':
+      if (!svg_number(&p, end, &v[0]) || !svg_number(&p, end, &v[1]))
+        return -1;
+      status = svg_push_line(svg, ox + v[0], oy + v[1], values, capacity, n_values);
+      break;
+    case 'H': case 'h':
+      if (!svg_number(&p, end, &v[0]))
+        return -1;
+      status = svg_push_line(svg, ox + v[0], svg->y, values, capacity, n_values);
+      break;
+    case 'V': case 'v':
+      if (!svg_number(&p, end, &v[0]))
+        return -1;
+      status = svg_push_line(svg, svg->x, oy + v[0], values, capacity, n_values);
+      break;
+    case 'C': case 'c':
+      if (!svg_number(&p, end, &v[0]) || !svg_number(&p, end, &v[1]) ||
+          !svg_number(&p, end, &v[2]) || !svg_number(&p, end, &v[3]) ||
+          !svg_number(&p, end, &v[4]) || !svg_number(&p, end, &v[5]))
+        return -1;
+      status = svg_push_cubic(svg, ox + v[0], oy + v[1], ox + v[2], oy + v[3],
+        ox + v[4], oy + v[5], values, capacity, n_values);
+      break;
+    case 'S': case 's':
+      if (!svg_number(&p, end, &v[2]) || !svg_number(&p, end, &v[3]) ||
+          !svg_number(&p, end, &v[4]) || !svg_number(&p, end, &v[5]))
+        return -1;
+      if (svg->previous == 'C' || svg->previous == 'S')
+      {
+        v[0] = 2*svg->x - svg->ctrl_x;
+        v[1] = 2*svg->y - svg->ctrl_y;
+      }
+      else
+      {
+        v[0] = svg->x;
+        v[1] = svg->y;
+      }
+      status = svg_push_cubic(svg, v[0], v[1], ox + v[2], oy + v[3],
+        ox + v[4], oy + v[5], values, capacity, n_values);
+      break;
+    case 'Q': case 'q':
+      if (!svg_number(&p, end, &v[0]) || !svg_number(&p, end, &v[1]) ||
+          !svg_number(&p, end, &v[2]) || !svg_number(&p, end, &v[3]))
+        return -1;
+      status = svg_push_quadratic(svg, ox + v[0], oy + v[1], ox + v[2], oy + v[3],
+        values, capacity, n_values);
+      break;
+    case 'T': case 't':
+      if (!svg_number(&p, end, &v[2]) || !svg_number(&p, end, &v[3]))
+        return -1;
+      if (svg->previous == 'Q' || svg->previous == 'T')
+      {
+        v[0] = 2*svg->x - svg->ctrl_x;
+        v[1] = 2*svg->y - svg->ctrl_y;
+      }
+      else
+      {
+        v[0] = svg->x;
+        v[1] = svg->y;
+      }
+      status = svg_push_quadratic(svg, v[0], v[1], ox + v[2], oy + v[3],
+        values, capacity, n_values);
+      break;
+    case 'Z': case 'z':
+      svg->data = p;
+      svg->command = command;
+      svg->previous = 'Z';
+      if (svg->x != svg->start_x || svg->y != svg->start_y)
+      {
+        if (svg_push_line(svg, svg->start_x, svg->start_y, values, capacity, n_values) == -1)
+          return -1;
+      }
+      svg->x = svg->start_x;
+      svg->y = svg->start_y;
+      if (*n_values > 0)
+        return 1;
+      continue;
+    default:
+      // Elliptical arcs (A) are not supported
+      return -1;
+    }
+
+    if (status == -1)
+      return -1;
+
+    svg->data = p;
+    svg->command = command;
+    svg->previous = command >= 'a' ? command - 'a' + 'A' : command;
+  }
+}
+
+void svg_begin(SvgReader* svg, const char* document, size_t size)
+{
+  memset(svg, 0, sizeof(SvgReader));
+  svg->pos = document;
+  svg->end = document + size;
+}
+
+int svg_next(SvgReader* svg, tsRational** values, size_t* capacity, size_t* n_values)
+{
+  *n_values = 0;
+  errno = 0;
+
+  for (;;)
+  {
+    if (svg->data == NULL)
+    {
+      int status = svg_next_element(svg);
+      if (status <= 0)
+      {
+        if (status == -1)
+          errno = EINVAL;
+        return status;
+      }
+    }
+
+    int status = svg_next_subpath(svg, values, capacity, n_values);
+    if (status == -1)
+    {
+      errno = (errno == ENOMEM) ? ENOMEM : EINVAL;
+      return -1;
+    }
+    if (status == 1)
+      return 1;
+
+    svg->data = NULL;
+  }
+}
@@ -0,0 +1,58 @@
+#ifndef SVG_H
+#define SVG_H
+
+#include <stddef.h>
+
+#include "tinyspline.h"
+
+#define SVG_MAX_DEPTH 64 /* maximum nesting of elements carrying transforms */
+
+/**
+ * An affine transform as used by the SVG transform attribute:
+ *      x' = a*x + c*y + e
+ *      y' = b*x + d*y + f
+ */
+typedef struct
+{
+  double a, b, c, d, e, f;
+} SvgMatrix;
+
+typedef struct
+{
+  const char* pos;        /* unread part of the document */
+  const char* end;        /* end of the document */
+  const char* data;       /* unread path data of the current element or NULL */
+  const char* data_end;   /* end of the path data */
+  char command;           /* last path command, repeated implicitly */
+  char previous;          /* the command of the previous segment (for S/T) */
+  int close_at_end;       /* close the subpath when data runs out (polygon) */
+  double x, y;            /* current point */
+  double start_x, start_y;/* first point of the current subpath */
+  double ctrl_x, ctrl_y;  /* last control point, reflected by S/T */
+  SvgMatrix transform;    /* user space transform of the current element */
+  SvgMatrix stack[SVG_MAX_DEPTH]; /* transforms of all open elements */
+  size_t depth;           /* number of open elements */
+} SvgReader;
+
+/**
+ * Prepares \svg to stream the drawable paths of \document.
+ */
+void svg_begin(SvgReader* svg, const char* document, size_t size);
+
+/**
+ * Reads the next subpath of the document into \values, growing it with
+ * realloc as needed (\capacity holds its current length). <path>, <polyline>
+ * and <polygon> elements are supported. M/L/H/V/C/S/Q/T/Z commands in
+ * absolute and relative form are converted to chains of cubic Bezier curves
+ * with four control points per segment, in the same layout that
+ * svgpreprocessor.py prints. The transforms of the element and all enclosing
+ * groups are applied to the control points.
+ *
+ * @return 1    if a subpath was read.
+ * @return 0    at the end of the document.
+ * @return -1   if the document is malformed, uses an unsupported command (A)
+ *              or allocating memory failed (errno is set).
+ */
+int svg_next(SvgReader* svg, tsRational** values, size_t* capacity, size_t* n_values);
+
+#endif // SVG_H
@@ -56,9 +56,9 @@ void ts_internal_deboornet_copy(
     copy->result = copy->points + (n_points-1)*dim;
 }
 
-void ts_internal_bspline_find_u(
+tsError ts_internal_bspline_locate_u(
     const tsBSpline* bspline, const tsRational u,
-    size_t* k, size_t* s, jmp_buf buf
+    size_t* k, size_t* s
 )
 {
     const size_t deg = bspline->deg;
@@ -77,15 +77,66 @@ void ts_internal_bspline_find_u(
 
     /* keep in mind that currently k is k+1 */
     if (*s > order)
-        longjmp(buf, TS_MULTIPLICITY);
+        return TS_MULTIPLICITY;
     if (*k <= deg)                /* u < u_min */
-        longjmp(buf, TS_U_UNDEFINED);
+        return TS_U_UNDEFINED;
     if (*k == n_knots && *s == 0) /* u > u_last */
-        longjmp(buf, TS_U_UNDEFINED);
+        return TS_U_UNDEFINED;
     if (*k > n_knots-deg + *s-1)  /* u > u_max */
-        longjmp(buf, TS_U_UNDEFINED);
+        return TS_U_UNDEFINED;
 
     (*k)--; /* k+1 - 1 will never underflow */
+    return TS_SUCCESS;
+}
+
+tsError ts_internal_bspline_advance_u(
+    const tsBSpline* bspline, const tsRational u,
+    size_t* cursor, size_t* k, size_t* s
+)
+{
+    const size_t deg = bspline->deg;
+    const size_t order = bspline->order;
+    const size_t n_knots = bspline->n_knots;
+    size_t i;
+
+    /* Move the cursor behind all knots that ::ts_internal_bspline_locate_u
+     * would pass for u. Since the u values are ascending, a knot passed once
+     * is passed for all following values as well. */
+    while (*cursor < n_knots) {
+        const tsRational uk = bspline->knots[*cursor];
+        if (!ts_fequals(u, uk) && u < uk)
+            break;
+        (*cursor)++;
+    }
+
+    /* The knots equal to u form a contiguous block in front of the cursor. */
+    *k = *cursor;
+    *s = 0;
+    for (i = *cursor; i > 0 && ts_fequals(u, bspline->knots[i-1]); i--)
+        (*s)++;
+
+    /* keep in mind that currently k is k+1 */
+    if (*s > order)
+        return TS_MULTIPLICITY;
+    if (*k <= deg)                /* u < u_min */
+        return TS_U_UNDEFINED;
+    if (*k == n_knots && *s == 0) /* u > u_last */
+        return TS_U_UNDEFINED;
+    if (*k > n_knots-deg + *s-1)  /* u > u_max */
+        return TS_U_UNDEFINED;
+
+    (*k)--; /* k+1 - 1 will never underflow */
+    return TS_SUCCESS;
+}
+
+void ts_internal_bspline_find_u(
+    const tsBSpline* bspline, const tsRational u,
+    size_t* k, size_t* s, jmp_buf buf
+)
+{
+    const tsError e = ts_internal_bspline_locate_u(bspline, u, k, s);
+    if (e < 0)
+        longjmp(buf, e);
 }
 
 void ts_internal_bspline_copy(
@@ -473,6 +524,64 @@ void ts_internal_bspline_evaluate(
     }
 }
 
+tsError ts_internal_bspline_evaluate_point(
+    const tsBSpline* bspline, const tsRational u, const size_t k,
+    const size_t s, tsRational* scratch, tsRational* result
+)
+{
+    const size_t deg = bspline->deg;
+    const size_t order = bspline->order;
+    const size_t dim = bspline->dim;
+    const size_t sof_c = dim * sizeof(tsRational); /* The size of a single
+ * control points.*/
+    const tsRational uk = bspline->knots[k];
+    const tsRational uu = ts_fequals(u, uk) ? uk : u; /* The actual used u. */
+    const size_t h = deg < s ? 0 : deg-s; /* prevent underflow */
+    size_t fst; /* The first affected control point, inclusive. */
+    size_t lst; /* The last affected control point, inclusive. */
+    size_t N; /* The number of affected control points. */
+    size_t r, i, j, d; /* Used in for loop. */
+    tsRational ui; /* The knot value at index i. */
+    tsRational a, a_hat; /* The weighting factors of the control points. */
+
+    /* Same case distinction as ::ts_internal_bspline_evaluate, but only the
+     * last point of the net is kept. Each level of the triangle overwrites
+     * the previous one in \scratch, which performs exactly the same
+     * operations and therefore yields bitwise identical results. */
+    if (s == order) {
+        if (k == deg) {                     /* only the first control point */
+            memcpy(result, bspline->ctrlp, sof_c);
+        } else if (k == bspline->n_knots - 1) { /* only the last one */
+            memcpy(result, bspline->ctrlp + (k-s) * dim, sof_c);
+        } else { /* discontinuous, the result is the second point */
+            memcpy(result, bspline->ctrlp + (k-s+1) * dim, sof_c);
+        }
+        return TS_SUCCESS;
+    }
+
+    fst = k-deg; /* k >= deg */
+    lst = k-s; /* s <= deg <= k */
+    N = lst-fst + 1; /* lst <= fst implies N >= 1 */
+    memcpy(scratch, bspline->ctrlp + fst*dim, N * sof_c);
+
+    for (r = 1; r <= h; r++) {
+        for (i = fst + r, j = 0; i <= lst; i++, j++) {
+            ui = bspline->knots[i];
+            a = (uu - ui) / (bspline->knots[i+deg-r+1] - ui);
+            a_hat = 1.f-a;
+
+            for (d = 0; d < dim; d++) {
+                scratch[j*dim + d] =
+                        a_hat * scratch[j*dim + d] +
+                        a * scratch[(j+1)*dim + d];
+            }
+        }
+    }
+
+    memcpy(result, scratch, sof_c);
+    return TS_SUCCESS;
+}
+
 void ts_internal_bspline_split(
     const tsBSpline* bspline, const tsRational u,
     tsBSpline* split, size_t* k, jmp_buf buf
@@ -1020,6 +1129,41 @@ tsError ts_bspline_evaluate(
     return err;
 }
 
+tsError ts_bspline_evaluate_point(
+    const tsBSpline* bspline, const tsRational u,
+    tsRational* scratch, tsRational* result
+)
+{
+    size_t k, s;
+    const tsError err = ts_internal_bspline_locate_u(bspline, u, &k, &s);
+    if (err < 0)
+        return err;
+    return ts_internal_bspline_evaluate_point(
+            bspline, u, k, s, scratch, result);
+}
+
+tsError ts_bspline_evaluate_many(
+    const tsBSpline* bspline, const tsRational* us, const size_t n,
+    tsRational* scratch, tsRational* points
+)
+{
+    const size_t dim = bspline->dim;
+    size_t cursor = 0; /* The knot span cursor. */
+    size_t i, k, s;
+    tsError err;
+
+    for (i = 0; i < n; i++) {
+        if (i > 0 && us[i] < us[i-1])
+            cursor = 0; /* not sorted, search from the start again */
+        err = ts_internal_bspline_advance_u(bspline, us[i], &cursor, &k, &s);
+        if (err < 0)
+            return err;
+        ts_internal_bspline_evaluate_point(
+                bspline, us[i], k, s, scratch, points + i*dim);
+    }
+    return TS_SUCCESS;
+}
+
 tsError ts_bspline_insert_knot(
     const tsBSpline* bspline, const tsRational u, const size_t n,
     tsBSpline* result, size_t* k
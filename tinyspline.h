@@ -348,6 +348,54 @@ tsError ts_bspline_evaluate(
     tsDeBoorNet* deBoorNet
 );
 
+/**
+ * Evaluates \bspline at knot value \u and stores only the resulting point
+ * (\bspline->dim values) in \result.
+ *
+ * In contrast to ::ts_bspline_evaluate this function never allocates memory
+ * and does not use setjmp/longjmp, which makes it suitable for tight sampling
+ * loops. The de Boor net is computed in place in \scratch, which must provide
+ * room for at least \bspline->order * \bspline->dim values and can be reused
+ * across calls. The result is bitwise identical to the result field of the
+ * net computed by ::ts_bspline_evaluate. In case of a discontinuous B-Spline
+ * at \u, the second point is returned.
+ *
+ * On error \result is not modified.
+ *
+ * @return TS_SUCCESS           on success.
+ * @return TS_MULTIPLICITY      if multiplicity of \u > order of \bspline.
+ * @return TS_U_UNDEFINED       if \bspline is not defined at \u.
+ */
+tsError ts_bspline_evaluate_point(
+    const tsBSpline* bspline, const tsRational u,
+    tsRational* scratch, tsRational* result
+);
+
+/**
+ * Evaluates \bspline at the \n knot values \us and stores the resulting
+ * points contiguously in \points (\n * \bspline->dim values).
+ *
+ * The values in \us are expected to be in ascending order. Instead of
+ * searching the knot vector from the start for every value, a knot span
+ * cursor is advanced from one value to the next, which makes the search
+ * amortized O(1) per value. Unsorted values are still evaluated correctly,
+ * but restart the search whenever a value is smaller than its predecessor.
+ * Like ::ts_bspline_evaluate_point this function never allocates memory and
+ * \scratch must provide room for \bspline->order * \bspline->dim values.
+ * The results are bitwise identical to individual calls of
+ * ::ts_bspline_evaluate_point.
+ *
+ * On error the points of all values in front of the failing one are stored.
+ *
+ * @return TS_SUCCESS           on success.
+ * @return TS_MULTIPLICITY      if multiplicity of a value > order of \bspline.
+ * @return TS_U_UNDEFINED       if \bspline is not defined at a value.
+ */
+tsError ts_bspline_evaluate_many(
+    const tsBSpline* bspline, const tsRational* us, const size_t n,
+    tsRational* scratch, tsRational* points
+);
+
 tsError ts_bspline_insert_knot(
     const tsBSpline* bspline, const tsRational u, const size_t n,
     tsBSpline* result, size_t* k
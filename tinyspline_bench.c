@@ -0,0 +1,106 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h> // Required for memcmp
+#include <math.h>
+#include <time.h>
+
+#include "tinyspline.h"
+
+// Times ts_bspline_evaluate, which allocates a de Boor net per point, against
+// ts_bspline_evaluate_point and ts_bspline_evaluate_many, which work in a
+// reused scratch buffer, on clamped cubic splines in the plane like the ones
+// main samples. Checks that all three give the same points and reports the
+// best of a few rounds in nanoseconds per point.
+
+#define BenchSamples 200000 /* points evaluated per spline */
+#define BenchRounds 5       /* the fastest one counts */
+
+static double now(void)
+{
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static void check(tsError error, const char* function)
+{
+  if (error != TS_SUCCESS)
+  {
+    fprintf(stderr,"Error: %s: %d\n", function, error);
+    exit(EXIT_FAILURE);
+  }
+}
+
+int main(void)
+{
+  static const size_t sizes[] = {4, 16, 64, 256}; /* control points */
+  tsRational* us = malloc(BenchSamples * sizeof(tsRational));
+  tsRational* evaluate = malloc(2 * BenchSamples * sizeof(tsRational));
+  tsRational* point = malloc(2 * BenchSamples * sizeof(tsRational));
+  tsRational* many = malloc(2 * BenchSamples * sizeof(tsRational));
+  if (us == NULL || evaluate == NULL || point == NULL || many == NULL)
+  {
+    fprintf(stderr,"Error: out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  int status = EXIT_SUCCESS;
+  fprintf(stdout,"ctrlp  evaluate  evaluate_point  evaluate_many  (ns/pt)\n");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+  {
+    tsBSpline spline;
+    ts_bspline_default(&spline);
+    check(ts_bspline_new(3, 2, sizes[s], TS_CLAMPED, &spline), "ts_bspline_new");
+    for (size_t i = 0; i < spline.n_ctrlp; i++)
+    {
+      spline.ctrlp[2 * i] = i + sin(i);
+      spline.ctrlp[2 * i + 1] = cos(3 * i) * 10;
+    }
+
+    const tsRational u0 = spline.knots[spline.deg], u1 = spline.knots[spline.n_ctrlp];
+    for (size_t i = 0; i < BenchSamples; i++)
+      us[i] = u0 + (u1 - u0) * i / (BenchSamples - 1);
+    tsRational scratch[spline.order * spline.dim];
+
+    double time_evaluate = INFINITY, time_point = INFINITY, time_many = INFINITY, start;
+    for (int round = 0; round < BenchRounds; round++)
+    {
+      start = now();
+      for (size_t i = 0; i < BenchSamples; i++)
+      {
+        tsDeBoorNet net;
+        ts_deboornet_default(&net);
+        check(ts_bspline_evaluate(&spline, us[i], &net), "ts_bspline_evaluate");
+        evaluate[2 * i] = net.result[0];
+        evaluate[2 * i + 1] = net.result[1];
+        ts_deboornet_free(&net);
+      }
+      time_evaluate = fmin(time_evaluate, now() - start);
+
+      start = now();
+      for (size_t i = 0; i < BenchSamples; i++)
+        check(ts_bspline_evaluate_point(&spline, us[i], scratch, &point[2 * i]), "ts_bspline_evaluate_point");
+      time_point = fmin(time_point, now() - start);
+
+      start = now();
+      check(ts_bspline_evaluate_many(&spline, us, BenchSamples, scratch, many), "ts_bspline_evaluate_many");
+      time_many = fmin(time_many, now() - start);
+    }
+
+    fprintf(stdout,"%5zu  %8.1f  %14.1f  %13.1f\n", sizes[s], time_evaluate * 1e9 / BenchSamples,
+      time_point * 1e9 / BenchSamples, time_many * 1e9 / BenchSamples);
+    if (memcmp(evaluate, point, 2 * BenchSamples * sizeof(tsRational)) != 0
+      || memcmp(evaluate, many, 2 * BenchSamples * sizeof(tsRational)) != 0)
+    {
+      fprintf(stderr,"Error: %zu control points: the evaluations differ\n", sizes[s]);
+      status = EXIT_FAILURE;
+    }
+    ts_bspline_free(&spline);
+  }
+
+  free(us);
+  free(evaluate);
+  free(point);
+  free(many);
+  return status;
+}
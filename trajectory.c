@@ -0,0 +1,170 @@
+#include <math.h>
+
+#include "trajectory.h"
+
+#define TRAJECTORY_COLUMNS 8
+#define TRAJECTORY_JOINTS 4 /* theta1, theta2, d3 and theta4 */
+
+int trajectory_new(Arena* arena, size_t capacity, Trajectory* trajectory)
+{
+  // Round the columns up to whole alignment units so each one starts aligned
+  const size_t per_unit = ARENA_ALIGNMENT / sizeof(tsRational);
+  const size_t stride = (capacity + per_unit - 1) / per_unit * per_unit;
+
+  tsRational* columns = arena_alloc(arena, sizeof(tsRational) * stride * TRAJECTORY_COLUMNS);
+  if (columns == NULL)
+    return -1;
+
+  trajectory->size = 0;
+  trajectory->capacity = capacity;
+  trajectory->x = columns;
+  trajectory->y = columns + stride;
+  trajectory->z = columns + stride * 2;
+  trajectory->theta1 = columns + stride * 3;
+  trajectory->theta2 = columns + stride * 4;
+  trajectory->d3 = columns + stride * 5;
+  trajectory->heading = columns + stride * 6;
+  trajectory->theta4 = columns + stride * 7;
+  return 0;
+}
+
+// The joint values a frame carries
+static inline void trajectory_steps(const Trajectory* trajectory, size_t i, double* steps)
+{
+  steps[0] = floor(trajectory->theta1[i]);
+  steps[1] = floor(trajectory->theta2[i]);
+  steps[2] = floor(trajectory->d3[i]);
+  steps[3] = floor(trajectory->theta4[i]);
+}
+
+// Distance of p from the segment a-b, the joints may turn back, so points
+// beyond the ends are not on it
+static double trajectory_segment_distance(const double* p, const double* a, const double* b)
+{
+  double ab[TRAJECTORY_JOINTS], ap[TRAJECTORY_JOINTS], t = 0, length = 0, distance = 0;
+  int k;
+
+  for (k = 0; k < TRAJECTORY_JOINTS; k++)
+  {
+    ab[k] = b[k] - a[k];
+    ap[k] = p[k] - a[k];
+    t += ab[k] * ap[k];
+    length += ab[k] * ab[k];
+  }
+  t = length > 0 ? t / length : 0;
+  t = t < 0 ? 0 : (t > 1 ? 1 : t);
+  for (k = 0; k < TRAJECTORY_JOINTS; k++)
+  {
+    const double d = ap[k] - t * ab[k];
+    distance += d * d;
+  }
+  return sqrt(distance);
+}
+
+int trajectory_simplify(Trajectory* trajectory, size_t first, size_t* last, double tolerance, Arena* arena)
+{
+  const size_t n = *last - first;
+  size_t i, k, m = 0, kept;
+
+  if (n < 2)
+    return 0;
+
+  size_t* survivors = arena_alloc(arena, sizeof(size_t) * n);
+  unsigned char* keep = arena_alloc(arena, n);
+  size_t* stack = arena_alloc(arena, sizeof(size_t) * 2 * n);
+  if (survivors == NULL || keep == NULL || stack == NULL)
+    return -1;
+
+  // Collapse runs of identical frames
+  double previous[TRAJECTORY_JOINTS], steps[TRAJECTORY_JOINTS];
+  for (i = first; i < *last; i++)
+  {
+    int same = m > 0;
+    trajectory_steps(trajectory, i, steps);
+    for (k = 0; k < TRAJECTORY_JOINTS; k++)
+    {
+      same = same && steps[k] == previous[k];
+      previous[k] = steps[k];
+    }
+    if (same)
+      continue;
+    survivors[m++] = i;
+  }
+
+  // Ramer-Douglas-Peucker over the survivors, iteratively
+  for (i = 0; i < m; i++)
+    keep[i] = 0;
+  keep[0] = keep[m-1] = 1;
+  size_t top = 0;
+  if (m > 2)
+  {
+    stack[top++] = 0;
+    stack[top++] = m - 1;
+  }
+  while (top > 0)
+  {
+    const size_t high = stack[--top], low = stack[--top];
+    double a[TRAJECTORY_JOINTS], b[TRAJECTORY_JOINTS], worst = -1;
+    size_t split = low;
+
+    trajectory_steps(trajectory, survivors[low], a);
+    trajectory_steps(trajectory, survivors[high], b);
+    for (k = low + 1; k < high; k++)
+    {
+      trajectory_steps(trajectory, survivors[k], steps);
+      double distance = trajectory_segment_distance(steps, a, b);
+      if (distance > worst)
+      {
+        worst = distance;
+        split = k;
+      }
+    }
+
+    if (worst > tolerance)
+    {
+      keep[split] = 1;
+      if (split - low > 1)
+      {
+        stack[top++] = low;
+        stack[top++] = split;
+      }
+      if (high - split > 1)
+      {
+        stack[top++] = split;
+        stack[top++] = high;
+      }
+    }
+  }
+
+  // Compact the columns, then move up the frames after the range
+  kept = first;
+  for (i = 0; i < m; i++)
+  {
+    if (!keep[i])
+      continue;
+    const size_t from = survivors[i];
+    trajectory->x[kept] = trajectory->x[from];
+    trajectory->y[kept] = trajectory->y[from];
+    trajectory->z[kept] = trajectory->z[from];
+    trajectory->theta1[kept] = trajectory->theta1[from];
+    trajectory->theta2[kept] = trajectory->theta2[from];
+    trajectory->d3[kept] = trajectory->d3[from];
+    trajectory->heading[kept] = trajectory->heading[from];
+    trajectory->theta4[kept] = trajectory->theta4[from];
+    kept++;
+  }
+  for (i = *last; i < trajectory->size; i++, kept++)
+  {
+    trajectory->x[kept] = trajectory->x[i];
+    trajectory->y[kept] = trajectory->y[i];
+    trajectory->z[kept] = trajectory->z[i];
+    trajectory->theta1[kept] = trajectory->theta1[i];
+    trajectory->theta2[kept] = trajectory->theta2[i];
+    trajectory->d3[kept] = trajectory->d3[i];
+    trajectory->heading[kept] = trajectory->heading[i];
+    trajectory->theta4[kept] = trajectory->theta4[i];
+  }
+  *last -= trajectory->size - kept;
+  trajectory->size = kept;
+  return 0;
+}
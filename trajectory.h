@@ -0,0 +1,52 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <stddef.h>
+
+#include "tinyspline.h"
+#include "arena.h"
+
+/**
+ * The frames of one stroke as columns: the cartesian position of the pen and
+ * the joint values inverse kinematics turns it into. Every column holds
+ * capacity values, the first size of which are in use.
+ */
+typedef struct
+{
+  size_t size;         /* number of frames */
+  size_t capacity;     /* length of every column */
+  tsRational* x;       /* pen position in inches */
+  tsRational* y;
+  tsRational* z;       /* -1 retracts the pen */
+  tsRational* theta1;  /* shoulder angle in encoder steps */
+  tsRational* theta2;  /* elbow angle in encoder steps */
+  tsRational* d3;      /* height of the linear actuator */
+  tsRational* heading; /* direction the pen moves in on the page in radians, version 3 frames only */
+  tsRational* theta4;  /* wrist roll in encoder steps, 0 unless the frames are version 3 */
+} Trajectory;
+
+/**
+ * Allocates the eight columns of \trajectory for \capacity frames in a single
+ * block of \arena and sets its size to 0.
+ *
+ * @return 0    on success.
+ * @return -1   if the arena could not allocate (errno is set).
+ */
+int trajectory_new(Arena* arena, size_t capacity, Trajectory* trajectory);
+
+/**
+ * Drops the frames in [\first, *\last) that a straight line in joint space
+ * replaces within \tolerance encoder steps, comparing the integer steps the
+ * frames carry, the wrist roll included. Runs of identical frames collapse
+ * first, then the Ramer-Douglas-Peucker algorithm keeps the frames farther
+ * than \tolerance from the segment between their kept neighbours. The first
+ * and last frame of the range survive. The frames after the range move up
+ * and *\last is set to the new end of the range.
+ *
+ * @return 0    on success.
+ * @return -1   if the arena could not allocate the scratch space (errno is
+ *              set).
+ */
+int trajectory_simplify(Trajectory* trajectory, size_t first, size_t* last, double tolerance, Arena* arena);
+
+#endif // TRAJECTORY_H